@@ -0,0 +1,82 @@
+/*
+ * bench.h - common code of the host-side benchmarks
+ *
+ * Every benchmark takes an optional -n runs argument (default BENCH_RUNS),
+ * times each variant that many times with bench_best() and reports the
+ * fastest run. Benchmarks with more options parse -n with bench_runs_arg().
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#define BENCH_RUNS	20
+
+struct bench_result {
+	uint64_t cycles;	/* TSC cycles of the fastest run */
+	uint64_t ns;		/* wall time of the same run */
+};
+
+static inline uint64_t rdtsc(void)
+{
+	uint32_t low, high;
+
+	__asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+	return ((uint64_t) high << 32) | low;
+}
+
+static inline uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* The runs argument of -n, 0 if it is not a positive number */
+static inline int bench_runs_arg(const char *arg)
+{
+	int runs = atoi(arg);
+
+	return runs > 0 ? runs : 0;
+}
+
+/* The number of runs from [-n runs], prints the usage and exits otherwise */
+static inline int bench_runs(int argc, char **argv)
+{
+	if (argc == 3 && strcmp(argv[1], "-n") == 0 && bench_runs_arg(argv[2]))
+		return bench_runs_arg(argv[2]);
+	if (argc != 1) {
+		fprintf(stderr, "usage: %s [-n runs]\n", argv[0]);
+		exit(1);
+	}
+	return BENCH_RUNS;
+}
+
+/*
+ * Time 'run(arg)' 'runs' times and return the fastest run; 'setup(arg)',
+ * if given, prepares every run and is not timed
+ */
+static inline struct bench_result bench_best(void (*setup)(void *), void (*run)(void *),
+					     void *arg, int runs)
+{
+	struct bench_result best = { UINT64_MAX, UINT64_MAX };
+
+	for (int i = 0; i < runs; i++) {
+		if (setup)
+			setup(arg);
+		uint64_t ns = now_ns(), start = rdtsc();
+		run(arg);
+		uint64_t cycles = rdtsc() - start;
+		ns = now_ns() - ns;
+		if (cycles < best.cycles) {
+			best.cycles = cycles;
+			best.ns = ns;
+		}
+	}
+	return best;
+}
@@ -0,0 +1,100 @@
+/*
+ * fb_bench.c - host-side benchmark for console glyph rendering
+ *
+ * Fills a 1024x768 screen (128x48 cells) with glyphs the way fb_output()
+ * used to, shifting every font row bit by bit into 8 separate pixel stores,
+ * and with fb_output() and fb_flush() from kernel/fb.c (compiled for the
+ * host, see the Makefile), which copy whole 8-pixel rows from a lookup table
+ * with non-temporal stores. Every run starts from a clean screen.
+ */
+
+#include "bench.h"
+
+#define WIDTH		1024
+#define HEIGHT		768
+#define FONT_WIDTH	8
+#define FONT_HEIGHT	16
+#define COLS		(WIDTH / FONT_WIDTH)
+#define ROWS		(HEIGHT / FONT_HEIGHT)
+#define HELLO_ROWS	3	/* printed by fb_init() */
+#define GLYPHS		(COLS * (ROWS - HELLO_ROWS))
+
+/* The console under test (kernel/fb.c, kernel/ascii_font.c) */
+void fb_init(unsigned int *fb, unsigned int width, unsigned int height);
+void fb_output(char ch);
+void fb_flush(void);
+extern unsigned char __ascii_font[2048];
+
+static char glyph(int i)
+{
+	return (char) (' ' + i % 95);
+}
+
+/* The per-pixel loop that fb_output() used before the lookup table */
+static void draw_bits(unsigned int *fb, size_t x, size_t y, char ch)
+{
+	unsigned char *ptr = &__ascii_font[(unsigned char) ch * (FONT_WIDTH * FONT_HEIGHT / 8)];
+	size_t cur = x * FONT_WIDTH + (y * FONT_HEIGHT) * WIDTH;
+
+	for (size_t j = 0; j < FONT_HEIGHT; j++) {
+		signed char bitmap = ptr[j];
+		for (size_t i = 0; i < FONT_WIDTH; i++) {
+			signed char color = (bitmap >> 7);
+			fb[cur + i] = (signed int) color;
+			bitmap <<= 1;
+		}
+		cur += WIDTH;
+	}
+}
+
+static void fill_bits(void *fb)
+{
+	for (int i = 0; i < GLYPHS; i++)
+		draw_bits(fb, i % COLS, HELLO_ROWS + i / COLS, glyph(i));
+}
+
+static void fill_table(void *fb)
+{
+	(void) fb;
+	for (int i = 0; i < GLYPHS; i++)
+		fb_output(glyph(i));
+	fb_flush();
+}
+
+static void clear(void *fb)
+{
+	fb_init(fb, WIDTH, HEIGHT);
+}
+
+static void report(const char *name, struct bench_result r)
+{
+	printf("%-10s %14llu %12.2f %14.0f\n", name, (unsigned long long) r.cycles,
+	       (double) r.cycles / GLYPHS, GLYPHS * 1e9 / r.ns);
+}
+
+int main(int argc, char **argv)
+{
+	size_t size = (size_t) WIDTH * HEIGHT * sizeof(unsigned int);
+	int runs = bench_runs(argc, argv);
+	unsigned int *a, *b;
+
+	a = aligned_alloc(4096, size);
+	b = aligned_alloc(4096, size);
+	if (!a || !b) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	struct bench_result bits = bench_best(clear, fill_bits, a, runs);
+	struct bench_result table = bench_best(clear, fill_table, b, runs);
+	if (memcmp(a, b, size) != 0) {
+		fprintf(stderr, "the screens differ\n");
+		return 1;
+	}
+
+	printf("%-10s %14s %12s %14s\n", "renderer", "TSC cycles", "per glyph", "glyphs/s");
+	report("bits", bits);
+	report("table", table);
+	printf("speedup %.2fx\n", (double) bits.cycles / table.cycles);
+	return 0;
+}
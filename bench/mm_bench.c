@@ -0,0 +1,370 @@
+/*
+ * mm_bench.c - host-side benchmark for the kernel memory allocator
+ *
+ * kernel_extra.c and kernel_malloc.c are compiled for the host with
+ * their allocator entry points renamed to mm_*() (see the Makefile), and
+ * mem_init() is handed a region of host memory in place of the kernel
+ * heap. Allocation traces are then replayed against them.
+ *
+ * A trace is a text file with one request per line:
+ *   a <id> <size>	allocate size bytes as block id
+ *   r <id> <size>	reallocate block id to size bytes
+ *   f <id>		free block id
+ * Lines starting with '#' and lines with a single number (the header of
+ * CS:APP malloc lab traces) are ignored. Synthetic traces are generated
+ * with -g, and -w writes the last loaded trace out so that a generated
+ * workload can be recorded and replayed later. With -c the heap
+ * consistency checker (the allocator is built with MM_DEBUG) runs after
+ * every request of the checking pass. Every trace is then replayed -n
+ * times and the fastest replay is reported.
+ */
+
+#include "bench.h"
+#include "../kernel/include/mm_stats.h"
+
+/* The allocator under test (renamed kernel symbols) */
+unsigned char mm_init(void);
+unsigned char mm_checkheap(unsigned char verbose);
+void mm_get_stats(struct mm_stats *stats);
+void *mm_malloc(size_t size);
+void mm_free(void *ptr);
+void *mm_realloc(void *ptr, size_t size);
+void mem_init(void *heapMemory, size_t heapMemorySize);
+void *mem_heap_lo(void);
+void *mem_heap_hi(void);
+
+/* For cpu_id() with MM_TCACHE=yes: Linux keeps the CPU number in IA32_TSC_AUX */
+unsigned char CpuHasRdtscp = 1;
+
+#define DEFAULT_HEAP_SIZE	(16UL << 20)
+
+typedef struct op_s {
+	char type;	/* 'a', 'r' or 'f' */
+	size_t id;
+	size_t size;
+} op_t;
+
+typedef struct trace_s {
+	const char *name;
+	op_t *ops;
+	size_t num_ops;
+	size_t num_ids;
+	void **ptrs;	/* the blocks of a replay, num_ids of them */
+} trace_t;
+
+static size_t HeapSize = DEFAULT_HEAP_SIZE;
+static void *HeapRegion;
+static int CheckHeap = 0;
+
+static void die(const char *msg, const char *arg)
+{
+	fprintf(stderr, "mm_bench: %s%s%s\n", msg, arg ? ": " : "", arg ? arg : "");
+	exit(1);
+}
+
+static void trace_push(trace_t *trace, size_t *cap, char type, size_t id, size_t size)
+{
+	if (trace->num_ops == *cap) {
+		*cap = *cap ? 2 * *cap : 1024;
+		trace->ops = realloc(trace->ops, *cap * sizeof(op_t));
+		if (!trace->ops)
+			die("out of memory", NULL);
+	}
+	trace->ops[trace->num_ops].type = type;
+	trace->ops[trace->num_ops].id = id;
+	trace->ops[trace->num_ops].size = size;
+	trace->num_ops++;
+	if (id >= trace->num_ids)
+		trace->num_ids = id + 1;
+}
+
+static void trace_load(trace_t *trace, const char *path)
+{
+	char line[256], type;
+	size_t cap = 0, id, size;
+	FILE *f = fopen(path, "r");
+
+	if (!f)
+		die("cannot open trace", path);
+	memset(trace, 0, sizeof(*trace));
+	trace->name = path;
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, " %c %zu %zu", &type, &id, &size) < 2 || type == '#')
+			continue;
+		if (type == 'f')
+			trace_push(trace, &cap, 'f', id, 0);
+		else if (type == 'a' || type == 'r')
+			trace_push(trace, &cap, type, id, size);
+	}
+	fclose(f);
+}
+
+static void trace_save(const trace_t *trace, const char *path)
+{
+	size_t i;
+	FILE *f = fopen(path, "w");
+
+	if (!f)
+		die("cannot write trace", path);
+	fprintf(f, "# %s\n", trace->name);
+	for (i = 0; i < trace->num_ops; i++) {
+		const op_t *op = &trace->ops[i];
+		if (op->type == 'f')
+			fprintf(f, "f %zu\n", op->id);
+		else
+			fprintf(f, "%c %zu %zu\n", op->type, op->id, op->size);
+	}
+	fclose(f);
+}
+
+static size_t rand_size(size_t lo, size_t hi)
+{
+	return lo + (size_t) rand() % (hi - lo + 1);
+}
+
+/*
+ * Synthetic workloads:
+ *   random	random mix of small and medium objects with random lifetimes
+ *   small	many small objects (kernel descriptors), freed in random order
+ *   binary	interleaved small/large pairs, the large ones freed first
+ *		(a classic fragmentation pattern)
+ *   realloc	buffers that grow step by step while small objects come and go
+ */
+static void trace_generate(trace_t *trace, const char *kind, size_t n)
+{
+	size_t cap = 0, i, *live, num_live = 0;
+
+	memset(trace, 0, sizeof(*trace));
+	trace->name = kind;
+	srand(473);
+	if (!strcmp(kind, "random") || !strcmp(kind, "small")) {
+		size_t hi = !strcmp(kind, "small") ? 128 : 2048;
+		live = malloc(n * sizeof(size_t));
+		for (i = 0; i < n; i++) {
+			if (num_live != 0 && rand() % 3 == 0) {
+				size_t k = (size_t) rand() % num_live;
+				trace_push(trace, &cap, 'f', live[k], 0);
+				live[k] = live[--num_live];
+			} else {
+				trace_push(trace, &cap, 'a', i, rand_size(1, hi));
+				live[num_live++] = i;
+			}
+		}
+		while (num_live != 0)
+			trace_push(trace, &cap, 'f', live[--num_live], 0);
+		free(live);
+	} else if (!strcmp(kind, "binary")) {
+		for (i = 0; i < n; i++) {
+			trace_push(trace, &cap, 'a', 2 * i, rand_size(16, 64));
+			trace_push(trace, &cap, 'a', 2 * i + 1, rand_size(256, 512));
+		}
+		for (i = 0; i < n; i++)
+			trace_push(trace, &cap, 'f', 2 * i + 1, 0);
+		for (i = 0; i < n; i++)
+			trace_push(trace, &cap, 'a', 2 * n + i, rand_size(512, 1024));
+		for (i = 0; i < n; i++) {
+			trace_push(trace, &cap, 'f', 2 * i, 0);
+			trace_push(trace, &cap, 'f', 2 * n + i, 0);
+		}
+	} else if (!strcmp(kind, "realloc")) {
+		size_t bufs = 16, size[16] = { 0 };
+		for (i = 0; i < bufs; i++) {
+			size[i] = rand_size(16, 256);
+			trace_push(trace, &cap, 'a', i, size[i]);
+		}
+		for (i = 0; i < n; i++) {
+			size_t k = (size_t) rand() % bufs;
+			size[k] += rand_size(16, 512);
+			trace_push(trace, &cap, 'r', k, size[k]);
+			trace_push(trace, &cap, 'a', bufs + i, rand_size(16, 128));
+			if (i != 0)
+				trace_push(trace, &cap, 'f', bufs + i - 1, 0);
+		}
+		trace_push(trace, &cap, 'f', bufs + n - 1, 0);
+		for (i = 0; i < bufs; i++)
+			trace_push(trace, &cap, 'f', i, 0);
+	} else {
+		die("unknown workload", kind);
+	}
+}
+
+static void heap_reset(void)
+{
+	mem_init(HeapRegion, HeapSize);
+	if (!mm_init())
+		die("mm_init failed", NULL);
+}
+
+static size_t heap_size(void)
+{
+	return (char *) mem_heap_hi() - (char *) mem_heap_lo() + 1;
+}
+
+/*
+ * Replays the trace once with payload checking and space accounting:
+ * every block is filled with a pattern derived from its id, which is
+ * verified before the block is freed or reallocated
+ */
+static int trace_check(const trace_t *trace, double *peak_util, double *avg_frag,
+		       struct mm_stats *stats)
+{
+	void **ptr = calloc(trace->num_ids, sizeof(void *));
+	size_t *size = calloc(trace->num_ids, sizeof(size_t));
+	size_t i, j, live = 0, peak_live = 0, peak_heap = 0;
+	double frag = 0;
+
+	heap_reset();
+	for (i = 0; i < trace->num_ops; i++) {
+		const op_t *op = &trace->ops[i];
+		unsigned char pattern = (unsigned char) (op->id * 7 + 1);
+		unsigned char *p = ptr[op->id];
+		size_t keep = 0;
+
+		if (op->type != 'a' && p) {
+			keep = (op->type == 'r' && op->size < size[op->id]) ? op->size : size[op->id];
+			for (j = 0; j < keep; j++) {
+				if (p[j] != pattern) {
+					fprintf(stderr, "%s: block %zu corrupted at op %zu\n",
+						trace->name, op->id, i);
+					return -1;
+				}
+			}
+		}
+		switch (op->type) {
+		case 'a':
+			p = mm_malloc(op->size);
+			break;
+		case 'r':
+			p = mm_realloc(p, op->size);
+			break;
+		default:
+			mm_free(p);
+			p = NULL;
+			break;
+		}
+		if (op->type != 'f') {
+			if (!p) {
+				fprintf(stderr, "%s: out of memory at op %zu\n", trace->name, i);
+				return -1;
+			}
+			if ((size_t) p & 15) {
+				fprintf(stderr, "%s: misaligned block at op %zu\n", trace->name, i);
+				return -1;
+			}
+			memset(p, pattern, op->size);
+		}
+		live -= size[op->id];
+		size[op->id] = op->type == 'f' ? 0 : op->size;
+		live += size[op->id];
+		ptr[op->id] = p;
+
+		if (live > peak_live)
+			peak_live = live;
+		if (heap_size() > peak_heap)
+			peak_heap = heap_size();
+		frag += 1.0 - (double) live / heap_size();
+		if (CheckHeap && !mm_checkheap(1)) {
+			fprintf(stderr, "%s: heap check failed at op %zu\n", trace->name, i);
+			return -1;
+		}
+	}
+	mm_get_stats(stats);
+	*peak_util = (double) peak_live / peak_heap;
+	*avg_frag = frag / trace->num_ops;
+	free(ptr);
+	free(size);
+	return 0;
+}
+
+static void replay_setup(void *arg)
+{
+	heap_reset();
+}
+
+/* Replays the trace without any checking */
+static void replay(void *arg)
+{
+	const trace_t *trace = arg;
+	void **ptr = trace->ptrs;
+
+	for (size_t i = 0; i < trace->num_ops; i++) {
+		const op_t *op = &trace->ops[i];
+		switch (op->type) {
+		case 'a':
+			ptr[op->id] = mm_malloc(op->size);
+			break;
+		case 'r':
+			ptr[op->id] = mm_realloc(ptr[op->id], op->size);
+			break;
+		default:
+			mm_free(ptr[op->id]);
+			break;
+		}
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr,
+		"usage: mm_bench [-c] [-H heap_bytes] [-n runs] [-w out.rep]\n"
+		"                [-g random|small|binary|realloc[:ops]] [trace.rep ...]\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	trace_t *traces = calloc(argc, sizeof(trace_t));
+	const char *record = NULL;
+	int i, num = 0, runs = BENCH_RUNS, failed = 0;
+
+	for (i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-c")) {
+			CheckHeap = 1;
+		} else if (!strcmp(argv[i], "-H") && i + 1 < argc) {
+			HeapSize = strtoul(argv[++i], NULL, 0);
+		} else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+			if ((runs = bench_runs_arg(argv[++i])) == 0)
+				usage();
+		} else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+			record = argv[++i];
+		} else if (!strcmp(argv[i], "-g") && i + 1 < argc) {
+			char *kind = argv[++i], *count = strchr(kind, ':');
+			if (count)
+				*count++ = '\0';
+			trace_generate(&traces[num++], kind, count ? strtoul(count, NULL, 0) : 20000);
+		} else if (argv[i][0] == '-') {
+			usage();
+		} else {
+			trace_load(&traces[num++], argv[i]);
+		}
+	}
+	if (num == 0)
+		usage();
+	if (record)
+		trace_save(&traces[num - 1], record);
+
+	HeapRegion = aligned_alloc(4096, HeapSize);
+	if (!HeapRegion)
+		die("cannot allocate the heap region", NULL);
+
+	printf("%-28s %10s %14s %10s %10s %10s %8s %8s %8s\n", "trace", "ops", "ops/sec",
+		"cycles/op", "peak util", "avg frag", "steps", "hits", "sbrk");
+	for (i = 0; i < num; i++) {
+		struct mm_stats stats;
+		double util, frag;
+		if (trace_check(&traces[i], &util, &frag, &stats) != 0) {
+			failed = 1;
+			continue;
+		}
+		traces[i].ptrs = calloc(traces[i].num_ids, sizeof(void *));
+		struct bench_result res = bench_best(replay_setup, replay, &traces[i], runs);
+		free(traces[i].ptrs);
+		printf("%-28s %10zu %14.0f %10.1f %9.1f%% %9.1f%% %8.2f %7.1f%% %8zu\n",
+			traces[i].name, traces[i].num_ops, traces[i].num_ops * 1e9 / res.ns,
+			(double) res.cycles / traces[i].num_ops, 100 * util, 100 * frag,
+			stats.searches ? (double) stats.search_steps / stats.searches : 0.0,
+			stats.mallocs ? 100.0 * stats.cache_hits / stats.mallocs : 0.0,
+			stats.sbrk_calls);
+	}
+	return failed;
+}
@@ -0,0 +1,171 @@
+/*
+ * printf_bench.c - host-side benchmark for formatted output
+ *
+ * Runs snprintf() and printf() over a few typical format strings (plain
+ * text, mixed conversions and wide padding) with the per-character
+ * formatter that kernel/printf.c used to be (bench/printf_chars.c) and
+ * with kernel/printf.c, which hands runs of characters to its output
+ * functions. Both are compiled for the host with their entry points
+ * renamed, see the Makefile. printf() output goes to a stand-in
+ * log_write() that copies it into a 16 KB ring like the kernel log does.
+ * Every format is first checked against the C library snprintf(). A run
+ * makes CALLS calls of one case.
+ */
+
+#include "bench.h"
+
+#define CALLS		100000	/* calls per run */
+#define LOG_SIZE	16384
+
+/* The formatters under test (bench/printf_chars.c, kernel/printf.c) */
+int c_snprintf(char *buf, size_t n, const char *fmt, ...);
+int c_printf(const char *fmt, ...);
+int k_snprintf(char *buf, size_t n, const char *fmt, ...);
+int k_printf(const char *fmt, ...);
+
+static const struct formatter {
+	const char *name;
+	int (*snprintf)(char *buf, size_t n, const char *fmt, ...);
+	int (*printf)(const char *fmt, ...);
+} Formatters[] = {
+	{ "chars", c_snprintf, c_printf },
+	{ "runs", k_snprintf, k_printf },
+};
+
+static char LogBuf[LOG_SIZE];
+static size_t LogPos, LogCalls;
+
+/* Stands in for the kernel log ring (kernel/kernel_log.c) */
+void log_write(const char *buf, size_t len)
+{
+	LogCalls++;
+	while (len != 0) {
+		size_t part = LOG_SIZE - LogPos % LOG_SIZE;
+
+		if (part > len)
+			part = len;
+		memcpy(LogBuf + LogPos % LOG_SIZE, buf, part);
+		LogPos += part;
+		buf += part;
+		len -= part;
+	}
+}
+
+#define TEXT_FMT	"The quick brown fox jumps over the lazy dog, again and again.\n"
+#define MIXED_FMT	"%s: pid %d, addr 0x%016lx, size %8zu, flags %-6s|\n"
+#define PADDED_FMT	"%40d|%-40s|\n"
+
+/* Format into 'buf' with snprintf() if 'n' != 0, with printf() otherwise */
+static int format_text(const struct formatter *f, char *buf, size_t n, int i)
+{
+	return n ? f->snprintf(buf, n, TEXT_FMT) : f->printf(TEXT_FMT);
+}
+
+static int format_mixed(const struct formatter *f, char *buf, size_t n, int i)
+{
+	return n ? f->snprintf(buf, n, MIXED_FMT, "task", i, (long) i * 4096, (size_t) i * 3, "rw")
+		: f->printf(MIXED_FMT, "task", i, (long) i * 4096, (size_t) i * 3, "rw");
+}
+
+static int format_padded(const struct formatter *f, char *buf, size_t n, int i)
+{
+	return n ? f->snprintf(buf, n, PADDED_FMT, -i, "left")
+		: f->printf(PADDED_FMT, -i, "left");
+}
+
+static const struct format {
+	const char *name;
+	int (*run)(const struct formatter *, char *, size_t, int);
+} Formats[] = {
+	{ "text", format_text },
+	{ "mixed", format_mixed },
+	{ "padded", format_padded },
+};
+
+/* Compare one call of every format with the C library */
+static int check(const struct formatter *f)
+{
+	char ours[256], libc[256];
+
+	for (int i = -3; i < 3; i++) {
+		snprintf(libc, sizeof(libc), TEXT_FMT);
+		if (format_text(f, ours, sizeof(ours), i) != (int) strlen(libc) || strcmp(ours, libc))
+			return -1;
+		snprintf(libc, sizeof(libc), MIXED_FMT, "task", i, (long) i * 4096, (size_t) i * 3, "rw");
+		if (format_mixed(f, ours, sizeof(ours), i) != (int) strlen(libc) || strcmp(ours, libc))
+			return -1;
+		snprintf(libc, sizeof(libc), PADDED_FMT, -i, "left");
+		if (format_padded(f, ours, sizeof(ours), i) != (int) strlen(libc) || strcmp(ours, libc))
+			return -1;
+	}
+	/* Truncation still counts the whole output */
+	if (f->snprintf(ours, 8, "%s-%d", "truncated", 42) != 12 || strcmp(ours, "truncat"))
+		return -1;
+	if (f->snprintf(NULL, 0, "%d", 12345) != 5)
+		return -1;
+	return 0;
+}
+
+/* One case: a format into snprintf() (n != 0) or printf() (n == 0) */
+struct run {
+	const struct formatter *formatter;
+	const struct format *format;
+	size_t n;
+	size_t bytes;		/* output of the last run */
+	char buf[256];
+};
+
+static void run_setup(void *arg)
+{
+	((struct run *) arg)->bytes = 0;
+}
+
+static void run_calls(void *arg)
+{
+	struct run *run = arg;
+
+	for (int i = 0; i < CALLS; i++)
+		run->bytes += run->format->run(run->formatter, run->buf, run->n, i);
+}
+
+/* Print one line per formatter and the speedup of the last one over the first */
+static void report(const char *sink, const struct format *format, size_t n, int runs)
+{
+	uint64_t cycles[sizeof(Formatters) / sizeof(Formatters[0])];
+	size_t count = sizeof(cycles) / sizeof(cycles[0]);
+
+	for (size_t i = 0; i < count; i++) {
+		struct run run = { &Formatters[i], format, n, 0, { 0 } };
+		LogCalls = 0;
+		struct bench_result res = bench_best(run_setup, run_calls, &run, runs);
+		cycles[i] = res.cycles / CALLS;
+		printf("%-9s %-8s %-6s %12llu %12.1f", sink, format->name, Formatters[i].name,
+		       (unsigned long long) cycles[i], (double) run.bytes * 1000 / res.ns);
+		if (n == 0)
+			printf(" %12.2f\n", (double) LogCalls / ((size_t) runs * CALLS));
+		else
+			printf(" %12s\n", "-");
+	}
+	printf("%-9s %-8s speedup %.2fx\n", sink, format->name, (double) cycles[0] / cycles[count - 1]);
+}
+
+int main(int argc, char **argv)
+{
+	int runs = bench_runs(argc, argv);
+
+	for (size_t i = 0; i < sizeof(Formatters) / sizeof(Formatters[0]); i++) {
+		if (check(&Formatters[i]) != 0) {
+			fprintf(stderr, "the output of '%s' differs from the C library\n",
+				Formatters[i].name);
+			return 1;
+		}
+	}
+
+	printf("%-9s %-8s %-6s %12s %12s %12s\n", "sink", "format", "impl", "TSC cycles",
+	       "MB/s", "log writes");
+	for (size_t i = 0; i < sizeof(Formats) / sizeof(Formats[0]); i++)
+		report("snprintf", &Formats[i], 256, runs);
+	for (size_t i = 0; i < sizeof(Formats) / sizeof(Formats[0]); i++)
+		report("printf", &Formats[i], 0, runs);
+	return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * pt_bench.c - host-side benchmark for page table construction
+ *
+ * Builds the 4 KB identity map of the first 4 GB (1048576 PTEs and 2048
+ * PDEs, 8 MB of tables) the way kernel_init() used to, storing each
+ * bitfield of every entry separately, and with pt_fill() from
+ * kernel/kernel_pt.c (compiled for the host, see the Makefile), which
+ * writes whole 64-bit entries. Times are in TSC cycles (see bench.h).
+ */
+
+#include "bench.h"
+
+#define PTES		1048576
+#define PDES		2048
+#define PTE_PRESENT	(1ULL << 0)
+#define PTE_WRITABLE	(1ULL << 1)
+#define PTE_TABLE	(PTE_PRESENT | PTE_WRITABLE)
+
+/* The builder under test (kernel/kernel_pt.c) */
+void pt_fill(uint64_t *table, size_t count, uint64_t addr, uint64_t step, uint64_t flags);
+
+/* The bitfield entries that kernel_init() used before pt_fill() */
+struct page_pte {
+	uint64_t present:1;
+	uint64_t writable:1;
+	uint64_t user_mode:1;
+	uint64_t otherbits:9;
+	uint64_t page_address:40;
+	uint64_t avail:7;
+	uint64_t pke:4;
+	uint64_t nonexecute:1;
+};
+struct page_pde {
+	uint64_t present:1;
+	uint64_t writable:1;
+	uint64_t user_mode:1;
+	uint64_t otherbits:9;
+	uint64_t page_address:40;
+	uint64_t avail:11;
+	uint64_t nonexecute:1;
+};
+
+/* Both builders fill one buffer: PTES PTEs followed by PDES PDEs */
+static void build_bitfields(void *pt)
+{
+	struct page_pte *p = pt;
+	struct page_pde *pd = (struct page_pde *) (p + PTES);
+
+	for (int i = 0; i < PTES; i++) {
+		p[i].present = 1;
+		p[i].writable = 1;
+		p[i].user_mode = 0;
+		p[i].otherbits = 0;
+		p[i].page_address = i;
+		p[i].avail = 0;
+		p[i].pke = 0;
+		p[i].nonexecute = 0;
+	}
+	for (int j = 0; j < PDES; j++) {
+		pd[j].present = 1;
+		pd[j].writable = 1;
+		pd[j].user_mode = 0;
+		pd[j].otherbits = 0;
+		pd[j].page_address = (uint64_t) (p + 512 * j) >> 12;
+		pd[j].avail = 0;
+		pd[j].nonexecute = 0;
+	}
+}
+
+static void build_bulk(void *pt)
+{
+	uint64_t *pdt = (uint64_t *) pt + PTES;
+
+	pt_fill(pt, PTES, 0, 4096, PTE_PRESENT | PTE_WRITABLE);
+	pt_fill(pdt, PDES, (uint64_t) pt, 4096, PTE_TABLE);
+}
+
+int main(int argc, char **argv)
+{
+	size_t size = (size_t) (PTES + PDES) * sizeof(uint64_t);
+	int runs = bench_runs(argc, argv);
+	void *a, *b;
+
+	a = aligned_alloc(4096, size);
+	b = aligned_alloc(4096, size);
+	if (!a || !b) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+	/* Touch all pages before timing */
+	memset(a, 0, size);
+	memset(b, 0, size);
+
+	uint64_t bitfields = bench_best(NULL, build_bitfields, a, runs).cycles;
+	uint64_t bulk = bench_best(NULL, build_bulk, b, runs).cycles;
+	if (memcmp(a, b, (size_t) PTES * sizeof(uint64_t)) != 0) {
+		fprintf(stderr, "the PTEs differ\n");
+		return 1;
+	}
+
+	printf("%-10s %14s %12s\n", "builder", "TSC cycles", "per entry");
+	printf("%-10s %14llu %12.2f\n", "bitfields", (unsigned long long) bitfields,
+	       (double) bitfields / (PTES + PDES));
+	printf("%-10s %14llu %12.2f\n", "pt_fill", (unsigned long long) bulk,
+	       (double) bulk / (PTES + PDES));
+	printf("speedup %.2fx\n", (double) bitfields / bulk);
+	return 0;
+}
@@ -13,9 +13,53 @@ extern unsigned char __ascii_font[2048]; /* ascii_font.c */
 #define FONT_WIDTH 8
 #define FONT_HEIGHT 16
 
+/* The largest console in text cells, bigger screens use the top left part */
+#define FB_MAX_COLS 320
+#define FB_MAX_ROWS 100
+
 static unsigned int *Fb;
 static unsigned int Width, PosX, PosY, MaxX, MaxY;
 
+/*
+ * The console is double-buffered in text form. The back buffer is the text
+ * being written, one byte per cell (0 is blank), kept as a circular buffer
+ * of rows: screen row y is FbText[(FbTop + y) % MaxY], so scrolling only
+ * advances FbTop. Cells at or after FbLen of their row are 0. The front
+ * buffer FbFront is the text that the framebuffer shows, by screen row.
+ *
+ * Writes only mark the cells they change as damaged, one span of columns
+ * per screen row [FbDamageLo, FbDamageHi). fb_flush() draws the damaged
+ * cells that differ from the front buffer, so a burst of output (e.g. many
+ * lines that scroll) is drawn once and the framebuffer is never read.
+ *
+ * Explicitly initialized so that they are part of the loaded image (.data,
+ * see -fno-zero-initialized-in-bss).
+ */
+static unsigned char FbText[FB_MAX_ROWS][FB_MAX_COLS] = { { 0 } };
+static unsigned short FbLen[FB_MAX_ROWS] = { 0 };
+static unsigned int FbTop = 0;
+static unsigned char FbFront[FB_MAX_ROWS][FB_MAX_COLS] = { { 0 } };
+static unsigned short FbFrontLen[FB_MAX_ROWS] = { 0 };
+static unsigned short FbDamageLo[FB_MAX_ROWS] = { 0 };
+static unsigned short FbDamageHi[FB_MAX_ROWS] = { 0 };
+static bool FbDamaged = false;
+
+/*
+ * The 8 pixels of every possible font row (the most significant bit is the
+ * leftmost pixel, white if set), so a glyph row is drawn with one 32-byte
+ * copy instead of 8 separate shifts and stores; built at compile time
+ */
+#define FB_PIXEL(row, bit)	(((row) & (0x80 >> (bit))) ? 0xFFFFFFFFU : 0x00000000U)
+#define FB_SPAN(row)	{ FB_PIXEL(row, 0), FB_PIXEL(row, 1), FB_PIXEL(row, 2), FB_PIXEL(row, 3), \
+			  FB_PIXEL(row, 4), FB_PIXEL(row, 5), FB_PIXEL(row, 6), FB_PIXEL(row, 7) }
+#define FB_SPAN4(row)	FB_SPAN(row), FB_SPAN((row) + 1), FB_SPAN((row) + 2), FB_SPAN((row) + 3)
+#define FB_SPAN16(row)	FB_SPAN4(row), FB_SPAN4((row) + 4), FB_SPAN4((row) + 8), FB_SPAN4((row) + 12)
+#define FB_SPAN64(row)	FB_SPAN16(row), FB_SPAN16((row) + 16), FB_SPAN16((row) + 32), FB_SPAN16((row) + 48)
+
+static const unsigned int FbSpans[256][FONT_WIDTH] __attribute__((aligned(32))) = {
+	FB_SPAN64(0), FB_SPAN64(64), FB_SPAN64(128), FB_SPAN64(192)
+};
+
 #define HELLO_STATEMENT \
 	"MiniOS Framebuffer Console (CMPSC 473)\nCopyright (C) 2021 Ruslan Nikolaev\n\n"
 
@@ -35,34 +79,138 @@ void fb_init(unsigned int *fb, unsigned int width, unsigned int height)
 	PosY = 0;
 	MaxX = width / FONT_WIDTH;
 	MaxY = height / FONT_HEIGHT;
+	if (MaxX > FB_MAX_COLS)
+		MaxX = FB_MAX_COLS;
+	if (MaxY > FB_MAX_ROWS)
+		MaxY = FB_MAX_ROWS;
+	for (i = 0; i < FB_MAX_ROWS; i++) {
+		size_t j;
+		for (j = 0; j < FbLen[i]; j++)
+			FbText[i][j] = 0;
+		for (j = 0; j < FbFrontLen[i]; j++)
+			FbFront[i][j] = 0;
+		FbLen[i] = 0;
+		FbFrontLen[i] = 0;
+		FbDamageLo[i] = FB_MAX_COLS;
+		FbDamageHi[i] = 0;
+	}
+	FbTop = 0;
+	FbDamaged = false;
 
 	/* Print a hello statement */
 	for (i = 0; i < sizeof(HELLO_STATEMENT)-1; i++) {
 		fb_output(__hello_statement[i]);
 	}
+	fb_flush();
+}
+
+/*
+ * Draw the cells [lo, hi) of screen row 'y' from 'text' (0 is blank) one
+ * pixel row at a time with non-temporal stores: each pixel row of the span
+ * is contiguous, so it goes to the write-combined framebuffer in full lines
+ * without reading it into the cache
+ */
+static void fb_span(size_t lo, size_t hi, size_t y, const unsigned char *text)
+{
+	unsigned int *line = &Fb[lo * FONT_WIDTH + (y * FONT_HEIGHT) * Width];
+	size_t i, j, x;
+	for (j = 0; j < FONT_HEIGHT; j++) {
+		unsigned int *dst = line;
+		for (x = lo; x < hi; x++) {
+			/* for simplicity, assume that FONT_WIDTH=8, i.e., fits in one byte */
+			unsigned char ch = text[x];
+			const unsigned int *span = FbSpans[ch ? __ascii_font[ch * FONT_HEIGHT + j] : 0];
+			for (i = 0; i < FONT_WIDTH; i += 2) {
+				long long pixels;
+				__builtin_memcpy(&pixels, &span[i], sizeof(pixels));
+				__builtin_ia32_movnti64((long long *) &dst[i], pixels);
+			}
+			dst += FONT_WIDTH;
+		}
+		line += Width;
+	}
 }
 
-static void fb_scrollup(void)
+/* Cells [lo, hi) of screen row 'y' may have changed */
+static inline void fb_damage(size_t y, size_t lo, size_t hi)
 {
-	/* Move the text up one row */
-	size_t cur = 0, count = Width * ((MaxY - 1) * FONT_HEIGHT);
-	size_t row = Width * FONT_HEIGHT;
-	do {
-		Fb[cur] = Fb[cur+row];
-		cur++;
-	} while (--count != 0);
-
-	/* Clean up the last row */
-	do {
-		Fb[cur] = 0x00000000U;
-		cur++;
-	} while (--row != 0);
+	if (lo < FbDamageLo[y])
+		FbDamageLo[y] = lo;
+	if (hi > FbDamageHi[y])
+		FbDamageHi[y] = hi;
+	FbDamaged = true;
+}
+
+/* Put 'ch' at column 'x' of screen row 'y' */
+static void fb_draw(size_t x, size_t y, char ch)
+{
+	size_t row = (FbTop + y) % MaxY;
+
+	FbText[row][x] = ch;
+	if (x >= FbLen[row])
+		FbLen[row] = x + 1;
+	fb_damage(y, x, x + 1);
+}
+
+/*
+ * Move the text up 'rows' rows (the whole screen at most) and clear the
+ * bottom; every screen row is damaged up to the longer of the text that
+ * it shows and the text that moves into its place
+ */
+static void fb_scroll(size_t rows)
+{
+	size_t y, x;
+
+	if (rows > MaxY)
+		rows = MaxY;
+
+	/* The rows that scrolled out come back empty at the bottom */
+	for (y = 0; y < rows; y++) {
+		size_t row = (FbTop + y) % MaxY;
+		for (x = 0; x < FbLen[row]; x++)
+			FbText[row][x] = 0;
+		FbLen[row] = 0;
+	}
+	FbTop = (FbTop + rows) % MaxY;
+
+	for (y = 0; y < MaxY; y++) {
+		size_t len = FbLen[(FbTop + y) % MaxY];
+		if (FbFrontLen[y] > len)
+			len = FbFrontLen[y];
+		if (len != 0)
+			fb_damage(y, 0, len);
+	}
+}
+
+void fb_flush(void)
+{
+	size_t y;
+
+	if (!FbDamaged)
+		return;
+	for (y = 0; y < MaxY; y++) {
+		size_t row = (FbTop + y) % MaxY;
+		size_t lo = FbDamageLo[y], hi = FbDamageHi[y];
+
+		/* Only the cells from the first to the last that differ */
+		while (lo < hi && FbFront[y][lo] == FbText[row][lo])
+			lo++;
+		while (hi > lo && FbFront[y][hi - 1] == FbText[row][hi - 1])
+			hi--;
+		if (lo < hi) {
+			fb_span(lo, hi, y, FbText[row]);
+			__builtin_memcpy(&FbFront[y][lo], &FbText[row][lo], hi - lo);
+		}
+		FbFrontLen[y] = FbLen[row];
+		FbDamageLo[y] = FB_MAX_COLS;
+		FbDamageHi[y] = 0;
+	}
+	__builtin_ia32_sfence();
+	FbDamaged = false;
 }
 
 void fb_output(char ch)
 {
-	size_t cur;
-	unsigned char *ptr;
 	if ((signed char) ch <= 0) { /* not in the ASCII subset */
 		if (ch == 0) return;
 		ch = '?'; /* an unknown character */
@@ -73,23 +221,53 @@ void fb_output(char ch)
 	}
 	if (PosY == MaxY) {
 		PosY--;
-		fb_scrollup();
+		fb_scroll(1);
 	}
 	if (ch == '\n')
 		return;
-	ptr = &__ascii_font[(unsigned char) ch * (FONT_WIDTH * FONT_HEIGHT / 8)];
-	cur = (size_t) PosX * FONT_WIDTH + (PosY * FONT_HEIGHT) * Width;
-	size_t j;
-	for (j = 0; j < FONT_HEIGHT; j++) {
-		/* for simplicity, assume that FONT_WIDTH=8, i.e., fits in one byte */
-		signed char bitmap = ptr[j];
-		size_t i;
-		for (i = 0; i < FONT_WIDTH; i++) {
-			signed char color = (bitmap >> 7); /* propagate the sign bit */
-			Fb[cur + i] = (signed int) color; /* sign extend to 32 bits */
-			bitmap <<= 1;
+	fb_draw(PosX, PosY, ch);
+	PosX++;
+}
+
+void fb_write(const char *buf, size_t len)
+{
+	size_t i, x = PosX, y = PosY, scroll;
+
+	/* The row where the text ends if the screen did not scroll */
+	for (i = 0; i < len; i++) {
+		if (buf[i] == 0)
+			continue;
+		if (buf[i] == '\n' || x == MaxX) {
+			x = 0;
+			y++;
 		}
-		cur += Width;
+		if (buf[i] != '\n')
+			x++;
 	}
-	PosX++;
+
+	/* Scroll once by the total, the text of rows that scroll out is skipped */
+	scroll = y >= MaxY ? y - MaxY + 1 : 0;
+	if (scroll != 0)
+		fb_scroll(scroll);
+
+	x = PosX;
+	y = PosY;
+	for (i = 0; i < len; i++) {
+		char ch = buf[i];
+		if ((signed char) ch <= 0) { /* as in fb_output() */
+			if (ch == 0) continue;
+			ch = '?';
+		}
+		if (ch == '\n' || x == MaxX) {
+			x = 0;
+			y++;
+		}
+		if (ch == '\n')
+			continue;
+		if (y >= scroll)
+			fb_draw(x, y - scroll, ch);
+		x++;
+	}
+	PosX = x;
+	PosY = y - scroll;
 }
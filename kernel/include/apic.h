@@ -0,0 +1,21 @@
+#pragma once
+
+#include <types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Start the local APIC timer at 'hz' ticks per second on VEC_TIMER,
+ * calibrated against the TSC. Returns 0 on success, -1 if there is no
+ * local APIC or the TSC frequency is unknown.
+ */
+int apic_timer_init(unsigned int hz);
+
+/* Signal the end of an interrupt to the local APIC */
+void apic_eoi(void);
+
+#ifdef __cplusplus
+}
+#endif
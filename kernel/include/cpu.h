@@ -0,0 +1,125 @@
+#pragma once
+
+#include <types.h>
+
+/* CPUID feature bits */
+#define CPUID_MAX		0x00000000
+#define CPUID_FEATURES		0x00000001
+#define CPUID_ECX_PCID		(1U << 17)
+#define CPUID_EDX_APIC		(1U << 9)
+#define CPUID_FEATURES7		0x00000007
+#define CPUID_7_EBX_INVPCID	(1U << 10)
+#define CPUID_TSC		0x00000015	/* TSC/crystal clock ratio */
+#define CPUID_FREQ		0x00000016	/* base frequency in MHz */
+#define CPUID_EXT_MAX		0x80000000
+#define CPUID_EXT_FEATURES	0x80000001
+#define CPUID_EXT_EDX_NX	(1U << 20)
+#define CPUID_EXT_EDX_PAGE1GB	(1U << 26)
+#define CPUID_EXT_EDX_RDTSCP	(1U << 27)
+
+/* Control register bits */
+#define CR0_WP			(1ULL << 16)	/* read-only pages also apply to the kernel */
+#define CR3_NOFLUSH		(1ULL << 63)	/* keep the TLB entries of the new PCID */
+#define CR3_PCID_MASK		0xFFFULL
+#define CR4_PGE			(1ULL << 7)
+#define CR4_PCIDE		(1ULL << 17)
+
+/* INVPCID types */
+#define INVPCID_ADDRESS		0	/* one address in one PCID */
+#define INVPCID_CONTEXT		1	/* all non-global entries of one PCID */
+
+static inline void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t *eax,
+			 uint32_t *ebx, uint32_t *ecx, uint32_t *edx)
+{
+	__asm__ __volatile__ ("cpuid"
+		: "=a" (*eax),
+		  "=b" (*ebx),
+		  "=c" (*ecx),
+		  "=d" (*edx)
+		: "a" (leaf),
+		  "c" (subleaf)
+	);
+}
+
+static inline uint64_t read_cr0(void)
+{
+	uint64_t val;
+
+	__asm__ __volatile__ ("movq %%cr0, %0" : "=r" (val));
+	return val;
+}
+
+static inline void write_cr0(uint64_t val)
+{
+	__asm__ __volatile__ ("movq %0, %%cr0" : : "r" (val) : "memory");
+}
+
+static inline uint64_t read_cr3(void)
+{
+	uint64_t val;
+
+	__asm__ __volatile__ ("movq %%cr3, %0" : "=r" (val));
+	return val;
+}
+
+static inline void write_cr3(uint64_t val)
+{
+	__asm__ __volatile__ ("movq %0, %%cr3" : : "r" (val) : "memory");
+}
+
+static inline uint64_t read_cr2(void)
+{
+	uint64_t val;
+
+	__asm__ __volatile__ ("movq %%cr2, %0" : "=r" (val));
+	return val;
+}
+
+static inline void invlpg(void *addr)
+{
+	__asm__ __volatile__ ("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
+static inline uint64_t read_cr4(void)
+{
+	uint64_t val;
+
+	__asm__ __volatile__ ("movq %%cr4, %0" : "=r" (val));
+	return val;
+}
+
+static inline void write_cr4(uint64_t val)
+{
+	__asm__ __volatile__ ("movq %0, %%cr4" : : "r" (val) : "memory");
+}
+
+static inline void invpcid(uint64_t type, uint64_t pcid, void *addr)
+{
+	struct {
+		uint64_t pcid;
+		uint64_t addr;
+	} desc = { pcid, (uint64_t) addr };
+
+	__asm__ __volatile__ ("invpcid %0, %1" : : "m" (desc), "r" (type) : "memory");
+}
+
+static inline uint64_t rdtsc(void)
+{
+	uint32_t low, high;
+
+	__asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+	return ((uint64_t) high << 32) | low;
+}
+
+static inline uint8_t inb(uint16_t port)
+{
+	uint8_t val;
+
+	__asm__ __volatile__ ("inb %1, %0" : "=a" (val) : "Nd" (port));
+	return val;
+}
+
+static inline void outb(uint16_t port, uint8_t val)
+{
+	__asm__ __volatile__ ("outb %0, %1" : : "a" (val), "Nd" (port));
+}
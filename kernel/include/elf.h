@@ -0,0 +1,60 @@
+#pragma once
+
+#include <types.h>
+#include <vmm.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ELF64 file header */
+typedef struct {
+	uint8_t e_ident[16];
+	uint16_t e_type;
+	uint16_t e_machine;
+	uint32_t e_version;
+	uint64_t e_entry;
+	uint64_t e_phoff;
+	uint64_t e_shoff;
+	uint32_t e_flags;
+	uint16_t e_ehsize;
+	uint16_t e_phentsize;
+	uint16_t e_phnum;
+	uint16_t e_shentsize;
+	uint16_t e_shnum;
+	uint16_t e_shstrndx;
+} Elf64_Ehdr;
+
+/* ELF64 program header */
+typedef struct {
+	uint32_t p_type;
+	uint32_t p_flags;
+	uint64_t p_offset;
+	uint64_t p_vaddr;
+	uint64_t p_paddr;
+	uint64_t p_filesz;
+	uint64_t p_memsz;
+	uint64_t p_align;
+} Elf64_Phdr;
+
+#define ELFCLASS64	2
+#define ET_EXEC		2
+#define EM_X86_64	62
+#define PT_LOAD		1
+#define PF_X		0x1
+#define PF_W		0x2
+#define PF_R		0x4
+
+/*
+ * Load the ELF64 executable 'image' of at most 'size' bytes into the user
+ * half of 'space': every PT_LOAD segment is copied into new frames mapped
+ * with the segment's permissions, and the user heap starts after the last
+ * one. Returns the entry point, or NULL if the image is not a valid x86-64
+ * executable within 'size' bytes or memory runs out; nothing stays mapped
+ * then.
+ */
+void *elf_load(address_space_t *space, const void *image, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
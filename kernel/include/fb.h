@@ -1,12 +1,32 @@
 #pragma once
 
+#include <types.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void fb_init(unsigned int *fb, unsigned int width, unsigned int height);
+/*
+ * Output goes to a back buffer in RAM and only appears on the screen when
+ * fb_flush() draws the cells that changed since the last flush
+ */
 void fb_output(char ch);
 
+/*
+ * Output 'len' characters as fb_output() would, scrolling at most once:
+ * text that would scroll off the screen is skipped
+ */
+void fb_write(const char *buf, size_t len);
+
+/*
+ * Draw the pending output. printf() and puts() only append to the kernel
+ * log; log_drain() writes it out and flushes, synchronously until
+ * log_defer() and from the timer tick after that. SYS_WRITE flushes
+ * before it returns.
+ */
+void fb_flush(void);
+
 #ifdef __cplusplus
 }
 #endif
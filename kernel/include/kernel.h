@@ -19,8 +19,16 @@ void user_jump(void * addr); /* an initial jump to user mode, addr is a VIRTUAL
  */
 extern void *syscall_entry_ptr;
 
-/* the system call handler */
-long syscall_entry(long n, long a1, long a2, long a3, long a4, long a5);
+/* A pointer to page_fault_asm(), initialized in kernel_entry.S for the same reason */
+extern void *page_fault_entry_ptr;
+
+/* Pointers to timer_asm() and spurious_asm(), likewise */
+extern void *timer_entry_ptr;
+extern void *spurious_entry_ptr;
+
+/* the system call handler of the numbers outside of syscall_table, see syscall.h */
+struct trap_frame;
+void syscall_entry(struct trap_frame *tf);
 
 /* kernel initialization */
 void kernel_init(void *ustack, void *uprogram, void *memory, size_t memorySize);
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * The kernel log: printf() and puts() append their output to a ring of
+ * LOG_SIZE bytes, which is shown on the console by log_drain(). Until
+ * log_defer() is called, every write is drained right away; after that,
+ * writers only copy into the ring and the console catches up from the
+ * timer interrupt (or when the ring is half full).
+ */
+#define LOG_SIZE	(1U << 14)	/* a power of 2 */
+
+/* Append 'len' bytes, only the last LOG_SIZE bytes are kept if it is longer */
+void log_write(const char *buf, size_t len);
+
+/* Show everything written so far on the console */
+void log_drain(void);
+
+/* Stop draining on every write */
+void log_defer(void);
+
+/* Copy the last 'len' bytes of the log (at most) to 'buf', returns the number */
+size_t log_read(char *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <types.h>
+#include <mm_stats.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -9,6 +10,12 @@ extern "C" {
 bool mm_init();
 void* malloc(size_t size);
 void free(void* ptr);
+void* realloc(void* ptr, size_t size);
+void* calloc(size_t nmemb, size_t size);
+void* aligned_alloc(size_t alignment, size_t size);
+void mm_set_trim_threshold(size_t threshold);
+void mm_get_stats(struct mm_stats *stats);
+bool mm_checkheap(bool verbose); /* only checks anything with MM_DEBUG */
 
 void mem_init(void *heapMemory, size_t heapMemorySize);
 void mem_extra_test();
@@ -0,0 +1,31 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Allocator statistics, see mm_get_stats(); bench/mm_bench.c includes this
+ * header on the host, so it relies on size_t from the includer
+ */
+#define MM_NUM_CLASSES 16	/* segregated free list size classes */
+
+struct mm_stats {
+	size_t heap_bytes;	/* current heap size */
+	size_t used_bytes;	/* bytes in allocated blocks, headers included */
+	size_t free_bytes;	/* bytes in free blocks */
+	size_t cached_bytes;	/* part of used_bytes held in per-CPU caches */
+	size_t alloc_blocks;	/* allocated blocks, cached ones included */
+	size_t cached_blocks;	/* blocks held in per-CPU caches */
+	size_t free_blocks[MM_NUM_CLASSES]; /* free blocks per size class */
+	size_t mallocs;		/* malloc() and aligned_alloc() calls */
+	size_t frees;		/* free() calls */
+	size_t cache_hits;	/* malloc() calls served by a per-CPU cache */
+	size_t sbrk_calls;	/* mem_sbrk() calls, growing and trimming */
+	size_t searches;	/* free list searches */
+	size_t search_steps;	/* free blocks examined by those searches */
+};
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,16 +2,27 @@
 
 #include <types.h>
 
+#define MSR_APIC_BASE	0x0000001B
 #define MSR_EFER	0xC0000080
 #define MSR_STAR	0xC0000081
 #define MSR_LSTAR	0xC0000082
 #define MSR_SFMASK	0xC0000084
+#define MSR_TSC_AUX	0xC0000103
+
+/* APIC_BASE bits */
+#define APIC_BASE_ENABLE	(1ULL << 11)
+#define APIC_BASE_MASK		0x000FFFFFFFFFF000ULL
+
+/* EFER bits */
+#define EFER_SCE	(1ULL << 0)	/* SYSCALL/SYSRET */
+#define EFER_NXE	(1ULL << 11)	/* no-execute pages */
 
 /* GDT entries, do not re-arrange those! */
 #define GDT_KERNEL_CODE	0x08
 #define GDT_KERNEL_DATA	0x10
 #define GDT_USER_DATA	0x18
 #define GDT_USER_CODE	0x20
+#define GDT_TSS		0x28	/* 16 bytes, filled by trap_init() */
 
 static inline uint64_t rdmsr(uint32_t reg)
 {
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PAGE_SHIFT	12
+#define PAGE_SIZE	(1UL << PAGE_SHIFT)
+#define PAGE_MAX_ORDER	20	/* the largest block is 2^20 pages (4GB) */
+
+/*
+ * Physical page frame allocator (buddy system) for the memory after
+ * the kernel heap; memory is 1:1 mapped, so a frame address can also
+ * be used as a pointer
+ */
+void page_init(void *memory, size_t memorySize);
+void *page_alloc(unsigned int order); /* 2^order contiguous pages, NULL if none */
+void page_free(void *page, unsigned int order);
+size_t page_free_count(void); /* free pages */
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PT_ENTRIES	512	/* entries in every level of the page table */
+#define PML4_KERNEL	256	/* PML4 entries of the kernel (lower) half */
+
+/* The index of 'addr' in the level 4 (PML4), 3 (PDPT), 2 (PD), 1 (PT) table */
+#define PML4_INDEX(addr)	(((uint64_t) (addr) >> 39) & 0x1FF)
+#define PDPT_INDEX(addr)	(((uint64_t) (addr) >> 30) & 0x1FF)
+#define PD_INDEX(addr)		(((uint64_t) (addr) >> 21) & 0x1FF)
+#define PT_INDEX(addr)		(((uint64_t) (addr) >> 12) & 0x1FF)
+
+/*
+ * A page table entry of any level, composed as a whole 64-bit word from
+ * the bits below, e.g. PTE_MAKE(addr, PTE_PRESENT | PTE_WRITABLE)
+ */
+typedef uint64_t pte_t;
+
+#define PTE_PRESENT	(1ULL << 0)	// bit P
+#define PTE_WRITABLE	(1ULL << 1)	// bit R/W
+#define PTE_USER	(1ULL << 2)	// bit U/S
+#define PTE_PWT		(1ULL << 3)	// bit PWT
+#define PTE_PCD		(1ULL << 4)	// bit PCD
+#define PTE_ACCESSED	(1ULL << 5)	// bit A
+#define PTE_DIRTY	(1ULL << 6)	// bit D (leaf entries only)
+#define PTE_LARGE	(1ULL << 7)	// bit PS: maps a 2 MB (PDE) or 1 GB (PDPE) page
+#define PTE_GLOBAL	(1ULL << 8)	// bit G (leaf entries only)
+#define PTE_AVL_SHIFT	9		// 3 bits available to the kernel
+#define PTE_AVL_MASK	(7ULL << PTE_AVL_SHIFT)
+#define PTE_NX		(1ULL << 63)	// bit XD, reserved unless EFER.NXE is set
+#define PTE_ADDR_MASK	0x000FFFFFFFFFF000ULL	// physical address
+
+/* The flags of a table entry that points to the next level table */
+#define PTE_TABLE	(PTE_PRESENT | PTE_WRITABLE)
+
+#define PTE_MAKE(addr, flags)	(((uint64_t) (addr) & PTE_ADDR_MASK) | (flags))
+#define PTE_ADDR(pte)		((pte) & PTE_ADDR_MASK)
+
+/* The table that a table entry points to (tables are 1:1 mapped) */
+static inline pte_t *pte_table(pte_t pte)
+{
+	return (pte_t *) PTE_ADDR(pte);
+}
+
+/*
+ * Fill 'count' consecutive entries: entry i maps 'addr + i * step' with
+ * 'flags'. Used for whole runs of tables and pages, it stores two entries
+ * per SSE store instead of composing every entry separately.
+ */
+void pt_fill(pte_t *table, size_t count, uint64_t addr, uint64_t step, pte_t flags);
+
+#ifdef __cplusplus
+}
+#endif
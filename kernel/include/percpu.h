@@ -0,0 +1,46 @@
+#pragma once
+
+#include <types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The maximum number of CPUs with per-CPU state, must be a power of 2 */
+#define MAX_CPUS	8
+
+/* Set by percpu_init() if the CPU has RDTSCP and IA32_TSC_AUX */
+extern bool CpuHasRdtscp;
+
+/*
+ * Store the index of the executing CPU for cpu_id(), called by every CPU
+ * when it is brought up
+ */
+void percpu_init(unsigned int cpu);
+
+/*
+ * The index of the executing CPU: every CPU stores its index in IA32_TSC_AUX
+ * when it is brought up, which RDTSCP returns without serializing the pipeline.
+ * Without RDTSCP only the boot CPU (0) can run.
+ * Per-CPU data must only be touched with interrupts disabled (as everywhere in
+ * the kernel, including system calls) so that the CPU cannot change under us.
+ */
+static inline unsigned int cpu_id(void)
+{
+	uint32_t low, high, aux;
+
+	if (!CpuHasRdtscp)
+		return 0;
+
+	__asm__ __volatile__ ("rdtscp"
+		: "=a" (low),
+		  "=d" (high),
+		  "=c" (aux)
+	);
+
+	return aux & (MAX_CPUS - 1);
+}
+
+#ifdef __cplusplus
+}
+#endif
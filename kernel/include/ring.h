@@ -0,0 +1,50 @@
+#pragma once
+
+#include <types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A system call ring: one page shared with user mode where the program
+ * queues system calls (submissions) and later collects their results
+ * (completions), so that a whole batch costs a single SYS_RING_ENTER.
+ * Keep in sync with user/include/ring.h.
+ *
+ * The heads and tails are free-running counters, an entry is at the
+ * counter modulo RING_ENTRIES. User mode writes sq[] and sq_tail and
+ * advances cq_head; the kernel advances sq_head and writes cq[] and cq_tail.
+ * A queued call completes with what the direct system call returns, only
+ * SYS_RING_ENTER itself completes with -1.
+ */
+#define RING_ENTRIES	32	/* a power of 2 */
+
+/* Where SYS_RING_SETUP maps the ring, a guard page above the initial stack page */
+#define RING_USER_ADDR	0xFFFFFFFFFFE02000ULL
+
+struct ring_sqe {
+	uint64_t n;		/* the system call number */
+	uint64_t args[5];	/* a1,.., a5 */
+	uint64_t user_data;	/* copied to the completion */
+	uint64_t reserved;
+};
+
+struct ring_cqe {
+	uint64_t user_data;
+	int64_t result;		/* the return value of the system call */
+};
+
+struct syscall_ring {
+	uint32_t sq_head;
+	uint32_t sq_tail;
+	uint32_t cq_head;
+	uint32_t cq_tail;
+	uint8_t pad[48];	/* the entries start in their own cache line */
+	struct ring_sqe sq[RING_ENTRIES];
+	struct ring_cqe cq[RING_ENTRIES];
+};
+
+#ifdef __cplusplus
+}
+#endif
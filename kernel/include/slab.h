@@ -0,0 +1,23 @@
+#pragma once
+
+#include <types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Object caches for fixed-size kernel objects: each cache hands out slots of
+ * one size carved from slabs, so allocation and release are a freelist pop
+ * and push without any block search.
+ */
+typedef struct kmem_cache kmem_cache_t;
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align);
+void kmem_cache_destroy(kmem_cache_t *cache);
+void *kmem_cache_alloc(kmem_cache_t *cache);
+void kmem_cache_free(kmem_cache_t *cache, void *obj);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct spinlock_s {
+	volatile int locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT	{ 0 }
+
+static inline void spin_lock(spinlock_t *lock)
+{
+	while (__atomic_exchange_n(&lock->locked, 1, __ATOMIC_ACQUIRE)) {
+		/* wait with plain loads to keep the cache line shared */
+		while (__atomic_load_n(&lock->locked, __ATOMIC_RELAXED))
+			__asm__ __volatile__ ("pause");
+	}
+}
+
+static inline void spin_unlock(spinlock_t *lock)
+{
+	__atomic_store_n(&lock->locked, 0, __ATOMIC_RELEASE);
+}
+
+#ifdef __cplusplus
+}
+#endif
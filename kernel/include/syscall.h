@@ -0,0 +1,42 @@
+#pragma once
+
+/*
+ * System call numbers (also used from assembly),
+ * keep in sync with user/include/syscall.h
+ */
+#define SYS_NULL		0	/* does nothing, returns 0 */
+#define SYS_PRINT		1	/* a1: a NUL-terminated string */
+#define SYS_MM_STATS		2	/* a1: struct mm_stats * to fill */
+#define SYS_BRK			3	/* a1: the new heap end (0 to query), returns the heap end */
+#define SYS_RING_SETUP		4	/* maps a struct syscall_ring, returns its address */
+#define SYS_RING_ENTER		5	/* a1: the ring, runs its queued calls, returns the number */
+#define SYS_WRITE		6	/* a1: fd, a2: buffer, a3: length, returns the length written */
+#define SYS_DMESG		7	/* a1: buffer, a2: length, copies the end of the kernel log, returns the length */
+#define SYS_MAX			8	/* the number of entries in syscall_table */
+#define SYS_KERNEL_STATUS	1024	/* returns kernel_status */
+
+/* File descriptors of SYS_WRITE, both go to the console */
+#define STDOUT_FILENO		1
+#define STDERR_FILENO		2
+
+#ifndef __ASSEMBLER__
+
+#include <types.h>
+
+struct mm_stats;
+struct syscall_ring;
+
+/* The entries of syscall_table (kernel_asm.S), indexed by the number */
+long sys_null(void);
+long sys_print(const char *str);
+long sys_mm_stats(struct mm_stats *stats);
+long sys_brk(void *addr);
+long sys_ring_setup(void);
+long sys_ring_enter(struct syscall_ring *ring);
+long sys_write(int fd, const char *buf, size_t len);
+long sys_dmesg(char *buf, size_t len);
+
+/* Call the handler of syscall_table for 'n' from C, -1 if there is none */
+long syscall_call(long n, long a1, long a2, long a3, long a4, long a5);
+
+#endif
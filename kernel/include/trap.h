@@ -0,0 +1,33 @@
+#pragma once
+
+#include <types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Exception and interrupt vectors */
+#define VEC_PAGE_FAULT	14
+#define VEC_TIMER	32	/* the local APIC timer */
+#define VEC_SPURIOUS	255	/* spurious local APIC interrupts */
+
+/* The registers saved by an exception entry stub, see kernel_asm.S */
+struct trap_frame {
+	uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+	uint64_t rbp, rdi, rsi, rdx, rcx, rbx, rax;
+	uint64_t error;		/* the error code (pushed by the CPU) */
+	uint64_t rip, cs, rflags, rsp, ss;
+};
+
+/* Load the IDT and the TSS (the kernel stack for exceptions from user mode) */
+void trap_init(void);
+
+/* Called from page_fault_asm() with the saved registers */
+void page_fault_handler(struct trap_frame *tf);
+
+/* Called from timer_asm() on every tick, drains the kernel log */
+void timer_handler(struct trap_frame *tf);
+
+#ifdef __cplusplus
+}
+#endif
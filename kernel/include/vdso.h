@@ -0,0 +1,45 @@
+#pragma once
+
+#include <types.h>
+#include <vmm.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A page of kernel data mapped read-only into every user address space,
+ * so that user mode reads these values with plain loads instead of system
+ * calls. Keep in sync with user/include/vdso.h.
+ *
+ * Readers retry while 'seq' is odd or changes across their reads.
+ * The monotonic clock in nanoseconds is
+ * clock_ns + ((rdtsc() - clock_tsc) * ns_mult >> 32).
+ */
+#define VDSO_USER_ADDR	0xFFFFFFFFFFE03000ULL	/* right above the system call ring */
+
+struct vdso_data {
+	uint32_t seq;
+	uint32_t pad;
+	int64_t kernel_status;
+	uint64_t tsc_hz;	/* the TSC frequency, 0 if unknown */
+	uint64_t ns_mult;	/* nanoseconds per TSC cycle, 32.32 fixed point */
+	uint64_t clock_tsc;	/* the TSC at clock_ns */
+	uint64_t clock_ns;
+};
+
+/* The TSC frequency in Hz, 0 if unknown (found once, on the first call) */
+uint64_t tsc_hz(void);
+
+/* Allocate and fill the page, the clock starts at 0 */
+void vdso_init(void);
+
+/* Publish the current kernel_status */
+void vdso_update(void);
+
+/* Map the page at VDSO_USER_ADDR in 'space', 0 on success */
+int vdso_map(address_space_t *space);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Protection of mapped pages and reserved regions */
+#define VMM_WRITE	0x1
+#define VMM_USER	0x2
+#define VMM_EXEC	0x4	/* otherwise no-execute if EFER.NXE is set */
+#define VMM_OWNED	0x8	/* vmm_map(): the frame is freed by vmm_unmap() */
+
+/* The maximum number of reserved regions of an address space */
+#define VMM_MAX_REGIONS	32
+
+/* The largest user heap (see vmm_brk()) */
+#define VMM_HEAP_MAX	(1UL << 30)
+
+/* The number of PCIDs (0 is the kernel address space) */
+#define VMM_MAX_PCID	4096
+
+/*
+ * Virtual memory manager for 4 KB pages. Every address space has its own
+ * PML4, but the kernel (lower) half, PML4 entries 0-255, is the same in all
+ * of them: its tables are shared and its regions belong to the kernel
+ * address space, so kernel mappings made in one address space are visible
+ * in all. Intermediate tables are allocated from page_alloc() the first
+ * time an address below them is mapped. Addresses inside the identity map
+ * of the first 4 GB cannot be mapped, since it may use large pages.
+ *
+ * If the CPU supports PCIDs, every address space has its own, so switching
+ * between them keeps the TLB entries of both.
+ */
+typedef struct address_space address_space_t;
+
+/* Set up the kernel address space for the loaded page table 'pml4' */
+void vmm_init(void *pml4);
+
+address_space_t *vmm_kernel_space(void);
+address_space_t *vmm_current_space(void);
+
+/*
+ * A new address space whose user half only maps the vDSO page, NULL if out
+ * of memory or PCIDs or if vdso_init() has not run yet
+ */
+address_space_t *vmm_space_create(void);
+
+/* Free the user half of 'space' and 'space' itself, it must not be current */
+void vmm_space_destroy(address_space_t *space);
+
+/* Load 'space' into CR3 */
+void vmm_space_switch(address_space_t *space);
+
+/* Map the page at 'virt' to the physical page 'phys', 0 on success */
+int vmm_map(address_space_t *space, void *virt, uint64_t phys, unsigned int flags);
+
+/*
+ * Unmap all pages in [virt, virt + size); frames that were allocated on
+ * demand for a reserved region are returned to page_free()
+ */
+void vmm_unmap(address_space_t *space, void *virt, size_t size);
+
+/*
+ * Reserve [virt, virt + size) without allocating anything: every page is
+ * backed by a zeroed frame when it is first touched, 0 on success
+ */
+int vmm_reserve(address_space_t *space, void *virt, size_t size, unsigned int flags);
+
+/* Unmap a region previously reserved with vmm_reserve() and forget it */
+void vmm_release(address_space_t *space, void *virt, size_t size);
+
+/*
+ * Start the user heap of 'space' at 'start' (rounded up to a page), with an
+ * empty break; the program loader calls it after the last segment
+ */
+void vmm_heap_init(address_space_t *space, void *start);
+
+/*
+ * Move the end of the user heap to 'addr' (at most VMM_HEAP_MAX above its
+ * start), returning the new break, or the unchanged one if 'addr' is out of
+ * range or overlaps another region, so brk(NULL) returns the current break.
+ * Heap pages are allocated on first touch and freed when the heap shrinks.
+ */
+void *vmm_brk(address_space_t *space, void *addr);
+
+/*
+ * Whether user mode may read (or write, with VMM_WRITE in 'flags') all of
+ * [addr, addr + size) in 'space': every page is mapped for user mode or
+ * lies in a user region that vmm_fault() maps when it is touched
+ */
+bool vmm_user_range(address_space_t *space, const void *addr, size_t size, unsigned int flags);
+
+/*
+ * Resolve a page fault at 'addr' in the current address space with the #PF
+ * error code 'error', 0 if the faulting access can be restarted
+ */
+int vmm_fault(void *addr, uint64_t error);
+
+#ifdef __cplusplus
+}
+#endif
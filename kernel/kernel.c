@@ -9,16 +9,24 @@
 #include <types.h>
 #include <msr.h>
 #include <malloc.h>
+#include <percpu.h>
+#include <page.h>
 #include <fb.h>
+#include <trap.h>
 #include <printf.h>
+#include <apic.h>
+#include <log.h>
 
 void *kernel_stack; /* Initialized in kernel_entry.S */
 void *syscall_entry_ptr; /* Points to syscall_entry_asm(), initialized in kernel_entry.S; workarounds a linker bug */
+void *page_fault_entry_ptr; /* Points to page_fault_asm(), initialized in kernel_entry.S */
+void *timer_entry_ptr; /* Points to timer_asm(), initialized in kernel_entry.S */
+void *spurious_entry_ptr; /* Points to spurious_asm(), initialized in kernel_entry.S */
 
 static void syscall_init(void)
 {
 	/* Enable SYSCALL/SYSRET */
-	wrmsr(MSR_EFER, rdmsr(MSR_EFER) | 0x1);
+	wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_SCE);
 
 	/* GDT descriptors for SYSCALL/SYSRET (USER descriptors are implicit) */
 	wrmsr(MSR_STAR, ((uint64_t) GDT_KERNEL_DATA << 48) | ((uint64_t) GDT_KERNEL_CODE << 32));
@@ -26,11 +34,12 @@ static void syscall_init(void)
 	/* A system call entry point */
 	wrmsr(MSR_LSTAR, (uint64_t) syscall_entry_ptr);
 
-	/* Disable interrupts (IF) while in a syscall */
-	wrmsr(MSR_SFMASK, 1U << 9);
+	/* Disable interrupts (IF) and clear DF for the C handlers while in a syscall */
+	wrmsr(MSR_SFMASK, (1U << 9) | (1U << 10));
 }
 
 #define KERNEL_HEAP_SIZE (1U << 20) /* 1MB */
+#define LOG_DRAIN_HZ 100
 
 /* Used internally, do not modify */
 long kernel_status = 0;
@@ -44,11 +53,23 @@ void kernel_start(void *kstack, void *ustack, framebuffer_t *fb,
 		  void *ucode, void *memory, size_t memorySize)
 {
 	fb_init(fb->addr, fb->width, fb->height);
+	percpu_init(0); /* the boot CPU is CPU 0 */
 	syscall_init();
+	trap_init();
 	kernel_memory = memory + KERNEL_HEAP_SIZE;
 	kernel_memory_end = memory + memorySize;
 	mem_init(memory, KERNEL_HEAP_SIZE);
+	/* Before kernel_init(): the slab caches of the VMM already use malloc() */
+	if (!mm_init()) {
+		printf("ERROR: cannot initialize the kernel heap\n");
+		while (1) {}
+	}
+	page_init(kernel_memory, kernel_memory_end - kernel_memory);
 	kernel_init(ustack, ucode, memory + KERNEL_HEAP_SIZE, memorySize - KERNEL_HEAP_SIZE);
+
+	/* From now on, the kernel log is shown on the timer ticks of user mode */
+	if (apic_timer_init(LOG_DRAIN_HZ) == 0)
+		log_defer();
 	user_jump(user_program);
 
 	/* Never exit! */
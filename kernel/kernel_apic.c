@@ -0,0 +1,66 @@
+/*
+ * kernel_apic.c - the local APIC timer
+ */
+
+#include <apic.h>
+#include <types.h>
+#include <cpu.h>
+#include <msr.h>
+#include <trap.h>
+#include <vdso.h>
+
+/* Local APIC registers, offsets from the base (within the identity map) */
+#define APIC_EOI		0x0B0
+#define APIC_SVR		0x0F0	/* spurious interrupt vector */
+#define APIC_LVT_TIMER		0x320
+#define APIC_TIMER_INIT		0x380
+#define APIC_TIMER_COUNT	0x390
+#define APIC_TIMER_DIV		0x3E0
+
+#define APIC_SVR_ENABLE		(1U << 8)
+#define APIC_LVT_MASKED		(1U << 16)
+#define APIC_TIMER_PERIODIC	(1U << 17)
+#define APIC_DIV_16		0x3
+
+static volatile uint32_t *Apic = NULL;
+
+static inline uint32_t apic_read(unsigned int reg)
+{
+	return Apic[reg / 4];
+}
+
+static inline void apic_write(unsigned int reg, uint32_t val)
+{
+	Apic[reg / 4] = val;
+}
+
+int apic_timer_init(unsigned int hz)
+{
+	uint32_t eax, ebx, ecx, edx, ticks;
+	uint64_t base = rdmsr(MSR_APIC_BASE), tsc = tsc_hz(), start;
+
+	cpuid(CPUID_FEATURES, 0, &eax, &ebx, &ecx, &edx);
+	if (!(edx & CPUID_EDX_APIC) || !(base & APIC_BASE_ENABLE) || tsc == 0)
+		return -1;
+	Apic = (volatile uint32_t *) (base & APIC_BASE_MASK);
+	apic_write(APIC_SVR, APIC_SVR_ENABLE | VEC_SPURIOUS);
+
+	// count the timer ticks during 10 ms of the TSC
+	apic_write(APIC_TIMER_DIV, APIC_DIV_16);
+	apic_write(APIC_LVT_TIMER, APIC_LVT_MASKED);
+	apic_write(APIC_TIMER_INIT, 0xFFFFFFFFU);
+	start = rdtsc();
+	while (rdtsc() - start < tsc / 100) {}
+	ticks = 0xFFFFFFFFU - apic_read(APIC_TIMER_COUNT);
+	if (ticks == 0)
+		return -1;
+
+	apic_write(APIC_LVT_TIMER, APIC_TIMER_PERIODIC | VEC_TIMER);
+	apic_write(APIC_TIMER_INIT, (uint64_t) ticks * 100 / hz);
+	return 0;
+}
+
+void apic_eoi(void)
+{
+	apic_write(APIC_EOI, 0);
+}
@@ -10,211 +10,255 @@
 #include <printf.h>
 #include <malloc.h>
 #include <string.h>
+#include <syscall.h>
+#include <page.h>
+#include <cpu.h>
+#include <msr.h>
+#include <paging.h>
+#include <vmm.h>
+#include <elf.h>
+#include <trap.h>
+#include <vdso.h>
+#include <fb.h>
+#include <log.h>
+
+extern long kernel_status;
+
+#define USER_STACK_RESERVE	(1UL << 20) /* 1MB */
+#define USER_IMAGE_MAX		(1UL << 20) /* 1MB, the boot loader does not pass the size */
 
 void *page_table = NULL; /* Must be initialized to the page table address */
 void *user_stack = NULL; /* Must be initialized to a user stack virtual address */
 void *user_program = NULL; /* Must be initialized to a user program virtual address */
 
-// structure used to populate Level 1 entries
-struct page_pte {
-	uint64_t present:1; 		// bit P
-	uint64_t writable:1;		// bit R/W
-	uint64_t user_mode:1;		// bit U/S
-	uint64_t otherbits:9;
-	uint64_t page_address:40;	// physical address
-	uint64_t avail:7;		// reserved
-	uint64_t pke:4;			// MPK/MPE
-	uint64_t nonexecute:1;
-};
-// structure used to populate Level 2, 3, or 4 entries
-struct page_pde {
-	uint64_t present:1;		// bit P
-	uint64_t writable:1;		// bit R/W
-	uint64_t user_mode:1;		// bit U/S
-	uint64_t otherbits:9;
-	uint64_t page_address:40;	// physical address
-	uint64_t avail:11;		// reserved
-	uint64_t nonexecute:1;
-};
+#ifdef PAGING_4K
+// Maps the first 4 GB with 4 KB pages (1048576 PTEs in 2048 tables),
+// the only layout accepted by load_page_table()
+static int identity_map(pte_t *pdpe)
+{
+	// LEVEL 1 tables (2048 tables = 1048576 entries) - PTE 
+	pte_t *p = page_alloc(11);		// 2^11 contiguous pages
+	// LEVEL 2 TABLES (4 tables = 2048 entries) - PDE
+	pte_t *pd = page_alloc(2);		// 2^2 contiguous pages
+	if (!p || !pd)
+		return -1;
+
+	pt_fill(p, 1048576, 0, PAGE_SIZE, PTE_PRESENT | PTE_WRITABLE);
+	// LEVEL 2 TABLES (4 tables = 2048 entries) - PTE page addresses
+	pt_fill(pd, 2048, (uint64_t) p, PAGE_SIZE, PTE_TABLE);
+	// LEVEL 3 TABLE (1 table = 512 entries) - PDE page addresses
+	// initialize 4 entries in table
+	pt_fill(pdpe, 4, (uint64_t) pd, PAGE_SIZE, PTE_TABLE);
+	return 0;
+}
+#else
+extern char __kernel_start[], __text_end[], __rodata_end[], _end[]; /* kernel.lds */
+
+// Splits the large pages around the kernel image into 4 KB pages so that
+// text is read-only, rodata is read-only and no-execute, and everything
+// else is no-execute (the bounds come from kernel.lds)
+static int map_kernel_image(pte_t *pdpe, pte_t nx)
+{
+	uint64_t start = (uint64_t) __kernel_start & ~((1UL << 21) - 1);
+	uint64_t end = ((uint64_t) _end + (1UL << 21) - 1) & ~((1UL << 21) - 1);
+	uint64_t text = (uint64_t) __kernel_start;
+	uint64_t text_end = (uint64_t) __text_end, rodata_end = (uint64_t) __rodata_end;
+	pte_t data = PTE_PRESENT | PTE_WRITABLE | PTE_GLOBAL | nx;
+
+	// the boundaries are only page aligned if the image is
+	if ((text & (PAGE_SIZE - 1)) || end > (4UL << 30)) {
+		printf("ERROR: the kernel image is not page aligned below 4 GB, no W^X\n");
+		return -1;
+	}
+
+	for (uint64_t chunk = start; chunk < end; chunk += 1UL << 21) {
+		pte_t *pdpe_entry = &pdpe[PDPT_INDEX(chunk)];
+		if (*pdpe_entry & PTE_LARGE) {
+			// a 1 GB page, split it into 2 MB pages first
+			pte_t *pd = page_alloc(0);
+			if (!pd)
+				return -1;
+			pt_fill(pd, 512, chunk & ~((1UL << 30) - 1), 1UL << 21, data | PTE_LARGE);
+			*pdpe_entry = PTE_MAKE(pd, PTE_TABLE);
+		}
+
+		pte_t *pd_entry = &pte_table(*pdpe_entry)[PD_INDEX(chunk)];
+		if (!(*pd_entry & PTE_LARGE))
+			continue;
+		pte_t *pt = page_alloc(0);
+		if (!pt)
+			return -1;
+		// [chunk, text) data, [text, text_end) text, [text_end, rodata_end)
+		// rodata and [rodata_end, chunk + 2 MB) data
+		uint64_t bounds[5] = { chunk, text, text_end, rodata_end, chunk + (1UL << 21) };
+		pte_t flags[4] = { data, PTE_PRESENT | PTE_GLOBAL,
+				   PTE_PRESENT | PTE_GLOBAL | nx, data };
+		for (int r = 0; r < 4; r++) {
+			uint64_t from = bounds[r] < chunk ? chunk : bounds[r];
+			uint64_t to = bounds[r + 1] > chunk + (1UL << 21) ? chunk + (1UL << 21) : bounds[r + 1];
+			if (from < to)
+				pt_fill(pt + PT_INDEX(from), (to - from) >> PAGE_SHIFT, from,
+					PAGE_SIZE, flags[r]);
+		}
+		*pd_entry = PTE_MAKE(pt, PTE_TABLE);
+	}
+	return 0;
+}
+
+// Maps the first 4 GB with global 1 GB pages in the PDPE if the CPU supports
+// them, and with global 2 MB pages (4 tables = 2048 PDEs) otherwise;
+// only the kernel text is executable if the CPU supports NX
+static int identity_map(pte_t *pdpe)
+{
+	uint32_t eax, ebx, ecx, edx;
+	int page1gb = 0;
+	pte_t nx = 0;
+
+	cpuid(CPUID_EXT_MAX, 0, &eax, &ebx, &ecx, &edx);
+	if (eax >= CPUID_EXT_FEATURES) {
+		cpuid(CPUID_EXT_FEATURES, 0, &eax, &ebx, &ecx, &edx);
+		page1gb = (edx & CPUID_EXT_EDX_PAGE1GB) != 0;
+		nx = (edx & CPUID_EXT_EDX_NX) ? PTE_NX : 0;
+	}
+	// NX bits are reserved (and fault) unless EFER.NXE is set
+	if (nx)
+		wrmsr(MSR_EFER, rdmsr(MSR_EFER) | EFER_NXE);
+
+	pte_t flags = PTE_PRESENT | PTE_WRITABLE | PTE_LARGE | PTE_GLOBAL | nx;
+	if (page1gb) {
+		pt_fill(pdpe, 4, 0, 1UL << 30, flags); // 1 GB page addresses
+		return map_kernel_image(pdpe, nx);
+	}
+
+	// LEVEL 2 TABLES (4 tables = 2048 entries) - PDE
+	pte_t *pd = page_alloc(2);		// 2^2 contiguous pages
+	if (!pd)
+		return -1;
+	pt_fill(pd, 2048, 0, 1UL << 21, flags); // 2 MB page addresses
+	pt_fill(pdpe, 4, (uint64_t) pd, PAGE_SIZE, PTE_TABLE); // PDE page addresses
+	return map_kernel_image(pdpe, nx);
+}
+
+// Translates 'virt' like the MMU does, stopping at 1 GB and 2 MB pages;
+// returns the physical address or -1 if it is not mapped, '*flags' gets
+// the bits that hold at every level (PTE_WRITABLE, PTE_USER)
+static uint64_t pt_walk(pte_t *pml4, uint64_t virt, pte_t *flags)
+{
+	unsigned int shift[4] = { 39, 30, 21, 12 };
+	pte_t *table = pml4, entry = 0;
+
+	*flags = PTE_WRITABLE | PTE_USER;
+	for (int level = 0; level < 4; level++) {
+		entry = table[(virt >> shift[level]) & 0x1FF];
+		if (!(entry & PTE_PRESENT))
+			return (uint64_t) -1;
+		*flags &= entry;
+		if (level == 3 || ((entry & PTE_LARGE) && level > 0))
+			return PTE_ADDR(entry & ~((1ULL << shift[level]) - 1)) |
+				(virt & ((1ULL << shift[level]) - 1));
+		table = pte_table(entry);
+	}
+	return (uint64_t) -1;
+}
+
+// A sanity check of the large page layout before it is loaded: the first
+// 4 GB and the kernel image are identity mapped for the kernel only, the
+// kernel text is read-only and the user stack page is mapped for user
+// mode; returns NULL or what is wrong
+static const char *check_page_table(pte_t *pml4, void *ustack_virt, void *ustack_phys)
+{
+	pte_t flags;
+
+	for (uint64_t virt = 0; virt < (4UL << 30); virt += 1UL << 21) {
+		if (pt_walk(pml4, virt, &flags) != virt || (flags & PTE_USER))
+			return "the first 4 GB are not identity mapped";
+	}
+	for (uint64_t virt = (uint64_t) __kernel_start; virt < (uint64_t) _end; virt += PAGE_SIZE) {
+		if (pt_walk(pml4, virt, &flags) != virt || (flags & PTE_USER))
+			return "the kernel image is not identity mapped";
+		if (virt < (uint64_t) __text_end && (flags & PTE_WRITABLE))
+			return "the kernel text is writable";
+	}
+	if (pt_walk(pml4, (uint64_t) ustack_virt, &flags) != (uint64_t) ustack_phys ||
+	    (flags & (PTE_USER | PTE_WRITABLE)) != (PTE_USER | PTE_WRITABLE))
+		return "the user stack is not mapped";
+	return NULL;
+}
+#endif
 
 void kernel_init(void *ustack, void *uprogram, void *memory, size_t memorySize)
 {
 	// 'memory' points to the place where memory can be used to create
 	// page tables (assume 1:1 initial virtual-to-physical mappings here)
 	// 'memorySize' is the maximum allowed size, do not exceed that (given just in case)
+	// This range is managed by the page frame allocator (page_init() in kernel_start()),
+	// so all page table pages are taken from page_alloc()
 
 	// CREATE PAGE TABLE 
 
-	// LEVEL 1 tables (2048 tables = 1048576 entries) - PTE 
-	struct page_pte *p = (struct page_pte *) memory;
-	for (int i = 0; i < 1048576; i++) {
-		p[i].present = 1;
-		p[i].writable = 1;
-		p[i].user_mode = 0;
-		p[i].otherbits = 0;
-		p[i].page_address = i;
-		p[i].avail = 0;
-		p[i].pke = 0;
-		p[i].nonexecute = 0;
-	}
-	// LEVEL 2 TABLES (4 tables = 2048 entries) - PDE
-	struct page_pde *pd = (struct page_pde *) (p + 1048576);
-	for (int j = 0; j <2048; j++) {
-		struct page_pte *start_pte = p + 512 * j;
-		pd[j].present = 1;
-		pd[j].writable = 1;
-		pd[j].user_mode = 0;
-		pd[j].otherbits = 0;
-		pd[j].page_address = (uint64_t) start_pte >> 12; // PTE page address
-		pd[j].avail = 0;
-		pd[j].nonexecute = 0;
+	// LEVEL 3 TABLE, LEVEL 4 TABLE, and LEVEL 1-3 user tables
+	pte_t *pdpe = page_alloc(0);
+	pte_t *pmle4e = page_alloc(0);
+	pte_t *u_p = page_alloc(0);
+	pte_t *u_pd = page_alloc(0);
+	pte_t *u_pdpe = page_alloc(0);
+	if (!pdpe || !pmle4e || !u_p || !u_pd || !u_pdpe) {
+		printf("ERROR: no memory for page tables\n");
+		while (1) {}
 	}
+
 	// LEVEL 3 TABLE (1 table = 512 entries) - PDPE
-	struct page_pde *pdpe = (struct page_pde *) (pd + 2048);
-	// initialize 4 entries in table
-	for (int k = 0; k < 4; k++) {
-		struct page_pde *start_pde = pd + 512 * k;
-		pdpe[k].present = 1;
-		pdpe[k].writable = 1;
-		pdpe[k].user_mode = 0;
-		pdpe[k].otherbits = 0;
-		pdpe[k].page_address = (uint64_t) start_pde >> 12; // PDE page address
-		pdpe[k].avail = 0;
-		pdpe[k].nonexecute = 0;
-	}
-	// initialize extra entries in table
-	for (int k = 4; k < 512; k++) {
-		pdpe[k].present = 0;
-		pdpe[k].writable = 0;
-		pdpe[k].user_mode = 0;
-		pdpe[k].otherbits = 0;
-		pdpe[k].page_address = 0; 
-		pdpe[k].avail = 0;
-		pdpe[k].nonexecute = 0;
+	// zero the table, identity_map() fills the first 4 entries
+	memset(pdpe, 0, 4096);
+	if (identity_map(pdpe) != 0) {
+		printf("ERROR: cannot build the identity map\n");
+		while (1) {}
 	}
 	// LEVEL 4 TABLE (1 table = 512 entries) - PMLE4E
-        struct page_pde *pmle4e = (struct page_pde *) (pdpe + 512);
-	// initialize 1 entry in table
-	struct page_pde *start_pdpe = pdpe;
-	pmle4e[0].present = 1;
-	pmle4e[0].writable = 1;
-	pmle4e[0].user_mode = 0;
-	pmle4e[0].otherbits = 0;
-	pmle4e[0].page_address = (uint64_t) start_pdpe >> 12; // PDPE page address
-	pmle4e[0].avail = 0;
-	pmle4e[0].nonexecute = 0;
-	//initialize extra entries in table
-	for (int n = 1; n < 512; n++) {
-		pmle4e[n].present = 0;
-		pmle4e[n].writable = 0;
-		pmle4e[n].user_mode = 0;
-		pmle4e[n].otherbits = 0;
-		pmle4e[n].page_address = 0;
-		pmle4e[n].avail = 0;
-		pmle4e[n].nonexecute = 0;
-	}
+	// initialize 1 entry in table, zero the rest
+	memset(pmle4e, 0, 4096);
+	pmle4e[0] = PTE_MAKE(pdpe, PTE_TABLE); // PDPE page address
 
 	// INITIALIZE page table address
 	page_table = pmle4e;
 
 	// CREATE USER SPACE SUPPORT 
-	// get physical addresses for user program and user stack
+	// get physical address for user stack, the user program is an
+	// ELF image loaded by elf_load() below
 	void * phys_user_stack = ustack - 4096;  // corrected user stack page address
-	void * phys_user_program = uprogram;
 
-	// selected virtual addresses for user stack and user program (correspond to last entry in levels 4, 3 and 2 tables)
+	// selected virtual address for user stack (corresponds to last entry in levels 4, 3 and 2 tables)
 	void* v_user_stack   = (void *) 0xFFFFFFFFFFE00000; // entry 0 in level 1 user table
-	void* v_user_program = (void *) 0xFFFFFFFFFFFFF000; // entry 511 in level 1 user table
 	
 	// LEVEL 1 user table (1 table = 512 entries) - user PTE 
-	struct page_pte *u_p = (struct page_pte *) (pmle4e + 512);
 	// first initialize all entries with zeroes
-	for (int i = 0; i < 512; i++) {
-		u_p[i].present = 0;
-		u_p[i].writable = 0;
-		u_p[i].user_mode = 0;
-		u_p[i].otherbits = 0;
-		u_p[i].page_address = 0;
-		u_p[i].avail = 0;
-		u_p[i].pke = 0;
-		u_p[i].nonexecute = 0;
-	}	
+	memset(u_p, 0, 4096);
 	// initialize user stack entry in level 1 user table
-	u_p[0].present = 1;
-	u_p[0].writable = 1;
-	u_p[0].user_mode = 1;
-	u_p[0].otherbits = 0;
-	u_p[0].page_address = (uint64_t) phys_user_stack  >> 12; // user stack page address
-	u_p[0].avail = 0;
-	u_p[0].pke = 0;
-	u_p[0].nonexecute = 0;
-	// initialize user program entry in level 1 user table
-	u_p[511].present = 1;
-	u_p[511].writable = 1;
-	u_p[511].user_mode = 1;
-	u_p[511].otherbits = 0;
-	u_p[511].page_address = (uint64_t) phys_user_program >> 12; // user program page address
-	u_p[511].avail = 0;
-	u_p[511].pke = 0;
-	u_p[511].nonexecute = 0;
+	u_p[0] = PTE_MAKE(phys_user_stack, PTE_PRESENT | PTE_WRITABLE | PTE_USER); // user stack page address
+#ifndef PAGING_4K
+	if (rdmsr(MSR_EFER) & EFER_NXE)
+		u_p[0] |= PTE_NX;
+#endif
 
 	// LEVEL 2 user table (1 table = 512 entries) - user PDE
-	struct page_pde *u_pd = (struct page_pde *) (u_p + 512);
 	// initialize first 511 entries with zeroes
-	for (int j = 0; j < 511; j++) {
-		u_pd[j].present = 0;
-		u_pd[j].writable = 0;
-		u_pd[j].user_mode = 0;
-		u_pd[j].otherbits = 0;
-		u_pd[j].page_address = 0;
-		u_pd[j].avail = 0;
-		u_pd[j].nonexecute = 0;
-	}	
+	memset(u_pd, 0, 4096);
 	// initialize last entry in table
-	u_pd[511].present = 1;
-	u_pd[511].writable = 1;
-	u_pd[511].user_mode = 1;
-	u_pd[511].otherbits = 0;
-	u_pd[511].page_address = (uint64_t) u_p >> 12; // level 1 (PTE) page address
-	u_pd[511].avail = 0;
-	u_pd[511].nonexecute = 0;	
+	u_pd[511] = PTE_MAKE(u_p, PTE_TABLE | PTE_USER); // level 1 (PTE) page address
 
 	// LEVEL 3 user table (1 table = 512 entries) - user PDPE
-	struct page_pde *u_pdpe = (struct page_pde *) (u_pd + 512);
 	// initialize first 511 entries with zeroes
- 	for (int k = 0; k < 511; k++) {
-		u_pdpe[k].present = 0;
-		u_pdpe[k].writable = 0;
-		u_pdpe[k].user_mode = 0;
-		u_pdpe[k].otherbits = 0;
-		u_pdpe[k].page_address = 0;
-		u_pdpe[k].avail = 0;
-		u_pdpe[k].nonexecute = 0;
-	}	
+	memset(u_pdpe, 0, 4096);
 	// initialize last entry in table
-	u_pdpe[511].present = 1;
-	u_pdpe[511].writable = 1;
-	u_pdpe[511].user_mode = 1;
-	u_pdpe[511].otherbits = 0;
-	u_pdpe[511].page_address = (uint64_t) u_pd >> 12; // level 2 (PDE) page address
-	u_pdpe[511].avail = 0;
-	u_pdpe[511].nonexecute = 0;	
+	u_pdpe[511] = PTE_MAKE(u_pd, PTE_TABLE | PTE_USER); // level 2 (PDE) page address
 
 	// create entry in level 4 table
-	pmle4e[511].present = 1;
-	pmle4e[511].writable = 1;
-	pmle4e[511].user_mode = 1;
-	pmle4e[511].otherbits = 0;
-	pmle4e[511].page_address = (uint64_t) u_pdpe >> 12; // level 3 (PDPE) page address
-	pmle4e[511].avail = 0;
-	pmle4e[511].nonexecute = 0;
-	
-	// CHANGED after creating user page table
-	user_stack = v_user_stack + 4096;
+	pmle4e[511] = PTE_MAKE(u_pdpe, PTE_TABLE | PTE_USER); // level 3 (PDPE) page address
 
 	// CHANGED after creating user page table
-	user_program = v_user_program;
+	user_stack = v_user_stack + 4096;
 
+#ifdef PAGING_4K
 	// The remaining portion just loads the page table,
 	// this does not need to be changed:
 	// load 'page_table' into the CR3 register
@@ -222,30 +266,111 @@ void kernel_init(void *ustack, void *uprogram, void *memory, size_t memorySize)
 	if (err != NULL) {
 		printf("ERROR: %s\n", err);
 	}
+#else
+	// load_page_table() only accepts the 4 KB layout, so the large page
+	// table is loaded directly; kernel_status is only ever set by
+	// load_page_table() and stays 0 in this configuration
+	const char *err = check_page_table(page_table, v_user_stack, phys_user_stack);
+	if (err != NULL) {
+		printf("ERROR: %s\n", err);
+		while (1) {}
+	}
+	write_cr3((uint64_t) page_table);
+
+	// the identity map is global: toggling CR4.PGE flushes all global
+	// entries left by the firmware and then enables global pages
+	uint64_t cr4 = read_cr4();
+	write_cr4(cr4 & ~CR4_PGE);
+	write_cr4(cr4 | CR4_PGE);
+	write_cr0(read_cr0() | CR0_WP);
+#endif
+
+	// 'page_table' becomes the kernel address space (PCID 0)
+	vmm_init(page_table);
+
+	// the kernel data page, read-only for the program, is mapped into
+	// every user address space by vmm_space_create()
+	vdso_init();
+
+	// the program runs in an address space of its own (with its own PCID),
+	// 'page_table' keeps the user stack mapping that load_page_table() checks
+	address_space_t *space = vmm_space_create();
+	if (space == NULL || vmm_map(space, v_user_stack, (uint64_t) phys_user_stack,
+				     VMM_WRITE | VMM_USER) != 0) {
+		printf("ERROR: cannot create the user address space\n");
+		while (1) {}
+	}
+
+	// the stack can grow below its initial page, the pages are
+	// allocated by the page fault handler when they are touched
+	if (vmm_reserve(space, v_user_stack - USER_STACK_RESERVE,
+			USER_STACK_RESERVE, VMM_WRITE | VMM_USER) != 0) {
+		printf("ERROR: cannot reserve the user stack\n");
+	}
+
+	// map the segments of the user program
+	user_program = elf_load(space, uprogram, USER_IMAGE_MAX);
+	if (user_program == NULL) {
+		printf("ERROR: cannot load the user program\n");
+		while (1) {}
+	}
+	vmm_space_switch(space);
 
 	// The extra credit assignment
 	mem_extra_test();
 }
 
-/* The entry point for all system calls */
-long syscall_entry(long n, long a1, long a2, long a3, long a4, long a5)
+/*
+ * System call handlers, dispatched by syscall_entry_asm through syscall_table
+ * (kernel_asm.S) with the arguments a1,.., a5 in the usual C registers
+ */
+long sys_null(void)
 {
-	// Implemented the system call handler to print a message (n = 1)
-	// the system call number is in 'n', make sure it is valid!
-
-	// Arguments are passed in a1,.., a5 and can be of any type
-	// (including pointers, which are casted to 'long')
-	// For the project, we only use a1 which will contain the address
-	// of a string, cast it to a pointer appropriately 
+	return 0;
+}
 
+long sys_print(const char *str)
+{
 	// For simplicity, assume that the address supplied by the
 	// user program is correct
-	//
-	// Hint: see how 'printf' is used above, you want something very
-	// similar here
-	if (n==1){
-		printf("%s\n", (char*) a1);
-		return 0;
-	}
-	return -1; /* Success: 0, Failure: -1 */
+	printf("%s\n", str);
+	return 0;
+}
+
+// The user range is checked once and goes to the console without any
+// formatting, after the pending kernel log
+long sys_write(int fd, const char *buf, size_t len)
+{
+	if ((fd != STDOUT_FILENO && fd != STDERR_FILENO) ||
+			!vmm_user_range(vmm_current_space(), buf, len, 0))
+		return -1;
+	log_drain();
+	fb_write(buf, len);
+	fb_flush();
+	return (long) len;
+}
+
+long sys_mm_stats(struct mm_stats *stats)
+{
+	if (!vmm_user_range(vmm_current_space(), stats, sizeof(*stats), VMM_WRITE))
+		return -1;
+	mm_get_stats(stats);
+	return 0;
+}
+
+long sys_brk(void *addr)
+{
+	return (long) vmm_brk(vmm_current_space(), addr);
+}
+
+/*
+ * System call numbers outside of syscall_table (the slow path): 'tf' holds
+ * all user registers and the result goes to tf->rax
+ */
+void syscall_entry(struct trap_frame *tf)
+{
+	if (tf->rdi == SYS_KERNEL_STATUS)
+		tf->rax = kernel_status;
+	else
+		tf->rax = -1; /* Success: 0, Failure: -1 */
 }
@@ -0,0 +1,101 @@
+/*
+ * kernel_elf.c - ELF64 program loader
+ */
+
+#include <elf.h>
+#include <types.h>
+#include <page.h>
+#include <paging.h>
+#include <string.h>
+#include <vmm.h>
+
+static bool elf_valid(const Elf64_Ehdr *eh)
+{
+	return eh->e_ident[0] == 0x7F && eh->e_ident[1] == 'E' &&
+		eh->e_ident[2] == 'L' && eh->e_ident[3] == 'F' &&
+		eh->e_ident[4] == ELFCLASS64 && eh->e_type == ET_EXEC &&
+		eh->e_machine == EM_X86_64 && eh->e_phentsize == sizeof(Elf64_Phdr);
+}
+
+/* Copy a segment into new frames, page by page, and unmap them on failure */
+static int load_segment(address_space_t *space, const char *image, size_t size,
+			const Elf64_Phdr *ph)
+{
+	uint64_t start = ph->p_vaddr & ~(PAGE_SIZE - 1);
+	uint64_t end = (ph->p_vaddr + ph->p_memsz + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	uint64_t file_end = ph->p_vaddr + ph->p_filesz;
+	unsigned int flags = VMM_USER | VMM_OWNED;
+
+	// the file part must be in the image, the segment in the user half
+	// without wrapping around (the last pages hold the stack and the vDSO)
+	if (ph->p_offset > size || ph->p_filesz > size - ph->p_offset)
+		return -1;
+	if (ph->p_filesz > ph->p_memsz || PML4_INDEX(start) < PML4_KERNEL ||
+			end <= start || PML4_INDEX(end - 1) < PML4_KERNEL)
+		return -1;
+	if (ph->p_flags & PF_W)
+		flags |= VMM_WRITE;
+	if (ph->p_flags & PF_X)
+		flags |= VMM_EXEC;
+
+	for (uint64_t page = start; page != end; page += PAGE_SIZE) {
+		char *frame = page_alloc(0);
+		if (!frame) {
+			vmm_unmap(space, (void *) start, page - start);
+			return -1;
+		}
+		memset(frame, 0, PAGE_SIZE);
+
+		// the part of [p_vaddr, p_vaddr + p_filesz) in this page
+		uint64_t from = page < ph->p_vaddr ? ph->p_vaddr : page;
+		uint64_t to = page + PAGE_SIZE < file_end ? page + PAGE_SIZE : file_end;
+		if (from < to)
+			memcpy(frame + (from - page), image + ph->p_offset + (from - ph->p_vaddr), to - from);
+
+		if (vmm_map(space, (void *) page, (uint64_t) frame, flags) != 0) {
+			page_free(frame, 0);
+			vmm_unmap(space, (void *) start, page - start);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* Unmap the PT_LOAD segments before 'ph[n]', loaded by elf_load() */
+static void unload_segments(address_space_t *space, const Elf64_Phdr *ph, int n)
+{
+	for (int i = 0; i < n; i++) {
+		if (ph[i].p_type != PT_LOAD || ph[i].p_memsz == 0)
+			continue;
+		uint64_t start = ph[i].p_vaddr & ~(PAGE_SIZE - 1);
+		vmm_unmap(space, (void *) start, ph[i].p_vaddr + ph[i].p_memsz - start);
+	}
+}
+
+void *elf_load(address_space_t *space, const void *image, size_t size)
+{
+	const Elf64_Ehdr *eh = image;
+	const Elf64_Phdr *ph;
+	uint64_t heap = 0;
+
+	if (size < sizeof(*eh) || !elf_valid(eh))
+		return NULL;
+	// the program headers must be in the image too
+	if (eh->e_phoff > size || eh->e_phnum > (size - eh->e_phoff) / sizeof(*ph))
+		return NULL;
+	ph = (const Elf64_Phdr *) ((const char *) image + eh->e_phoff);
+	for (int i = 0; i < eh->e_phnum; i++) {
+		if (ph[i].p_type != PT_LOAD || ph[i].p_memsz == 0)
+			continue;
+		if (load_segment(space, image, size, &ph[i]) != 0) {
+			unload_segments(space, ph, i);
+			return NULL;
+		}
+		if (ph[i].p_vaddr + ph[i].p_memsz > heap)
+			heap = ph[i].p_vaddr + ph[i].p_memsz;
+	}
+	if (heap == 0)
+		return NULL;
+	vmm_heap_init(space, (void *) heap);
+	return (void *) eh->e_entry;
+}
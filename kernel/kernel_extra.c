@@ -9,6 +9,8 @@
 #include <types.h>
 #include <string.h>
 #include <printf.h>
+#include <percpu.h>
+#include <spinlock.h>
 
 /* What is the correct alignment? */
 #define ALIGNMENT 16
@@ -21,14 +23,83 @@ static size_t align(size_t x)
 
 static size_t HDRSIZE = 8;        // size of header/footer
 static size_t DHDRSIZE = 16;      // double the size of header/footer
+static size_t MINBLOCKSIZE = 32;  // hdr + pred + succ + ftr of a free block
 static size_t CHUNKSIZE = 1 <<12; // 4096 bytes
 static char *heap_listp;          // points to prologue block
 
-/* 
+/*
+ * A free block at the end of the heap that grows beyond trim_threshold bytes
+ * is cut back to CHUNKSIZE and the rest is returned with a negative mem_sbrk()
+ */
+#define DEFAULT_TRIM_THRESHOLD (1 << 16)  // 64 KB
+static size_t trim_threshold = DEFAULT_TRIM_THRESHOLD;
+
+/*
+ * Block format: every block starts with a header holding its size, the
+ * allocation bit (bit 0) and the allocation bit of the previous block (bit 1).
+ * Only free blocks carry a footer, allocated blocks use the whole remainder
+ * for payload; coalesce() learns whether the previous block is free from the
+ * prev-alloc bit and only then reads its footer.
+ */
+#define ALLOC_BIT 0x1
+#define PREV_ALLOC_BIT 0x2
+
+/*
+ * Segregated free lists: every free block sits in one of NUM_CLASSES explicit
+ * doubly linked lists. Class i holds blocks of size [2^(i+5), 2^(i+6)), the
+ * last class holds everything larger. The pred/succ links are kept in the
+ * first two words of the free block's payload.
+ */
+#define NUM_CLASSES MM_NUM_CLASSES
+static char *seg_lists[NUM_CLASSES];
+
+/*
+ * Heap counters for mm_get_stats(), protected by heap_lock like the heap;
+ * counters of the per-CPU fast paths live in struct tcache
+ */
+static struct {
+    size_t free_bytes;
+    size_t free_blocks[NUM_CLASSES];
+    size_t alloc_blocks;
+    size_t sbrk_calls;
+    size_t searches;
+    size_t search_steps;
+} counters = { 0 };
+
+/*
+ * The heap above is shared by all CPUs and protected by heap_lock. In front of
+ * it every CPU keeps a cache of small blocks (up to TCACHE_MAX_SIZE bytes) in
+ * one LIFO bin per block size, so most malloc()/free() calls never touch shared
+ * state. Cached blocks stay marked allocated in the heap. An empty bin is
+ * refilled and a full bin is drained TCACHE_BATCH blocks at a time under one
+ * lock acquisition. The caches are only built with MM_TCACHE: on a single CPU
+ * the bin bookkeeping costs more than the uncontended lock it saves, and
+ * without them struct tcache only holds the malloc()/free() counters.
+ */
+#define TCACHE_MAX_SIZE 256
+#define TCACHE_BINS (TCACHE_MAX_SIZE / ALIGNMENT - 1)   // block sizes 32, 48, ..., 256
+#define TCACHE_BIN_LIMIT 32
+#define TCACHE_BATCH 16
+
+struct tcache_bin {
+    char *head;             // cached blocks linked through their first payload word
+    size_t count;
+};
+struct tcache {
+    struct tcache_bin bins[TCACHE_BINS];
+    size_t mallocs;
+    size_t frees;
+    size_t hits;
+} __attribute__((aligned(64)));   // no false sharing between CPUs
+
+static struct tcache tcaches[MAX_CPUS] = { { { { NULL, 0 } }, 0, 0, 0 } };
+static spinlock_t heap_lock = SPINLOCK_INIT;
+
+/*
  * Helper functions to find block addresses and populate header/footer
  */
-static size_t packW (size_t size, char alloc) {
-    return size | alloc;
+static size_t packW (size_t size, char prev_alloc, char alloc) {
+    return size | (prev_alloc ? PREV_ALLOC_BIT : 0) | (alloc ? ALLOC_BIT : 0);
 }
 static size_t getW(char *p){
     return *(size_t *)p;
@@ -40,7 +111,13 @@ static size_t getSize(char *p){
     return getW(p) & ~0xf;
 }
 static size_t getAllocation(char *p) {
-    return getW(p) & 0x1;
+    return getW(p) & ALLOC_BIT;
+}
+static size_t getPrevAllocation(char *p) {
+    return getW(p) & PREV_ALLOC_BIT;
+}
+static void setPrevAllocation(char *p, char prev_alloc) {
+    putW(p, prev_alloc ? (getW(p) | PREV_ALLOC_BIT) : (getW(p) & ~PREV_ALLOC_BIT));
 }
 static char * getHeaderAddress(char *p) {
     return (p - HDRSIZE);
@@ -50,20 +127,55 @@ static char * getFooterAddress(char *p) {
     return (temp + getSize(temp) - HDRSIZE);
 }
 static char * getNextBlock(char *p) {
-    return ( p + getSize(getHeaderAddress(p))); 
+    return ( p + getSize(getHeaderAddress(p)));
 }
 static char * getPreviousBlock(char *p) {
-    char * temp = p - DHDRSIZE; // address of footer of previous block
-    return (p - getSize(temp)); 
+    char * temp = p - DHDRSIZE; // address of footer of previous block (only valid if it is free)
+    return (p - getSize(temp));
 }
 
-/* 
+/*
+ * Helper functions to access the free list links of a free block
+ */
+static char * getPred(char *p) {
+    return *(char **)p;
+}
+static char * getSucc(char *p) {
+    return *(char **)(p + HDRSIZE);
+}
+static void setPred(char *p, char *pred) {
+    *(char **)p = pred;
+}
+static void setSucc(char *p, char *succ) {
+    *(char **)(p + HDRSIZE) = succ;
+}
+static int getClass(size_t size) {
+    int cls = (63 - __builtin_clzl(size)) - 5;  // floor(log2(size)) - log2(MINBLOCKSIZE)
+    if (cls < 0) {
+        return 0;
+    }
+    return (cls < NUM_CLASSES) ? cls : (NUM_CLASSES - 1);
+}
+
+/*
  * Helper functions to implement memory allocator functions
  */
 static void *coalesce(void *ptr);
 static void *extend_heap(size_t words);
 static void *find_fit(size_t size);
 static void place(void *ptr, size_t size);
+static void insert_free_block(char *ptr);
+static void remove_free_block(char *ptr);
+static size_t adjust_size(size_t size);
+static void *alloc_block(size_t adjsize);
+static void shrink_block(char *ptr, size_t size);
+static bool grow_block(char *ptr, size_t size);
+static void trim_heap(char *ptr);
+static void free_block(void *ptr);
+static struct tcache *this_tcache(void);
+static struct tcache_bin *tcache_bin(struct tcache *tc, size_t size);
+static void tcache_refill(struct tcache_bin *bin, size_t size);
+static void tcache_drain(struct tcache_bin *bin);
 
 
 // Your mm_init(), malloc(), free() code from mm.c here
@@ -77,14 +189,21 @@ static void place(void *ptr, size_t size);
  */
 bool mm_init()
 {
+    //Start with all free lists and CPU caches empty
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        seg_lists[i] = NULL;
+    }
+    memset(tcaches, 0, sizeof(tcaches));
+    memset(&counters, 0, sizeof(counters));
     //Create initial empty head
+    counters.sbrk_calls++;
     if ((heap_listp = mem_sbrk(4*HDRSIZE)) == (void *)-1) {
-        return false;    
+        return false;
     }
     putW(heap_listp, 0);            //Initial padding for alignment purposes
-    putW(heap_listp +   (HDRSIZE), packW(DHDRSIZE, 1));   //Prologue header
-    putW(heap_listp + (2*HDRSIZE), packW(DHDRSIZE, 1));   //Prologue footer
-    putW(heap_listp + (3*HDRSIZE), packW(0, 1));          //Epilogue header
+    putW(heap_listp +   (HDRSIZE), packW(DHDRSIZE, 1, 1));   //Prologue header
+    putW(heap_listp + (2*HDRSIZE), packW(DHDRSIZE, 1, 1));   //Prologue footer
+    putW(heap_listp + (3*HDRSIZE), packW(0, 1, 1));          //Epilogue header
     heap_listp += (2*HDRSIZE);
 
     // Extend the empty heap with a free block of CHUNKSIZE bytes
@@ -99,20 +218,48 @@ bool mm_init()
  */
 void *malloc(size_t size)
 {
-    size_t adjsize;         // adjusted block size
-    size_t extendsize;      // amount to extend heap if there is no suitable space in heap
+    size_t adjsize;
+    struct tcache *tc;
+    struct tcache_bin *bin;
     char *ptr;
     // ignore spurious requests
     if (size == 0){
         return NULL;
     }
-    // find the adjusted block size including space for header/footer and alignment correction
-    adjsize = align(size + HDRSIZE + HDRSIZE);
-    // search block list for a suitable free block
+    adjsize = adjust_size(size);
+    tc = this_tcache();
+    tc->mallocs++;
+    // fast path: take a block from this CPU's cache
+    if ((bin = tcache_bin(tc, adjsize)) != NULL) {
+        if (bin->head == NULL) {
+            tcache_refill(bin, adjsize);
+        } else {
+            tc->hits++;
+        }
+        if ((ptr = bin->head) != NULL) {
+            bin->head = *(char **)ptr;
+            bin->count--;
+            return ptr;
+        }
+    }
+    spin_lock(&heap_lock);
+    ptr = alloc_block(adjsize);
+    spin_unlock(&heap_lock);
+    return ptr;
+}
+
+/*
+ * alloc_block: allocates a block of adjsize bytes (header included)
+ */
+static void *alloc_block(size_t adjsize)
+{
+    size_t extendsize;      // amount to extend heap if there is no suitable space in heap
+    char *ptr;
+    // search the free lists for a suitable free block
     if ((ptr = find_fit(adjsize)) != NULL) {    // block found, allocate
-        place(ptr, adjsize);                    // allocate block in found address 
+        place(ptr, adjsize);                    // allocate block in found address
         return ptr;
-    } 
+    }
     // no block was found, extend heap and allocate block
     extendsize = (adjsize > CHUNKSIZE) ? adjsize : CHUNKSIZE;  // extend heap a min of CHUNKSIZE bytes
     if ((ptr = extend_heap(extendsize/HDRSIZE)) == NULL){
@@ -127,52 +274,198 @@ void *malloc(size_t size)
  */
 void free(void *ptr)
 {
+    struct tcache *tc;
+    struct tcache_bin *bin;
     // ignore spurious requests
     if (ptr == NULL) {
         return;
     }
-    // update header and footer to indicate block is free
+    tc = this_tcache();
+    tc->frees++;
+    // fast path: keep a small block in this CPU's cache
+    if ((bin = tcache_bin(tc, getSize(getHeaderAddress(ptr)))) != NULL) {
+        if (bin->count >= TCACHE_BIN_LIMIT) {
+            tcache_drain(bin);
+        }
+        *(char **)ptr = bin->head;
+        bin->head = ptr;
+        bin->count++;
+        return;
+    }
+    spin_lock(&heap_lock);
+    free_block(ptr);
+    spin_unlock(&heap_lock);
+}
+
+/*
+ * free_block: returns a block to the heap, the caller holds heap_lock
+ */
+static void free_block(void *ptr)
+{
+    // update header and add a footer to indicate block is free
     size_t size = getSize(getHeaderAddress(ptr));
-    putW(getHeaderAddress(ptr),packW(size, 0));
-    putW(getFooterAddress(ptr),packW(size, 0));
-    coalesce(ptr);          // try to coalesce this free block with previous and/or next
+    char prev_alloc = getPrevAllocation(getHeaderAddress(ptr)) != 0;
+    putW(getHeaderAddress(ptr),packW(size, prev_alloc, 0));
+    putW(getFooterAddress(ptr),packW(size, prev_alloc, 0));
+    setPrevAllocation(getHeaderAddress(getNextBlock(ptr)), 0);
+    counters.alloc_blocks--;
+    ptr = coalesce(ptr);    // merge with free neighbours and put on a free list
+    trim_heap(ptr);         // give the top of the heap back if it got too large
     return;
 }
 
 /*
- * coalesce: Merges free block with previous and next block if possible
+ * mm_set_trim_threshold: sets how large the free block at the end of the heap
+ * may get before it is trimmed, SIZE_MAX disables trimming
+ */
+void mm_set_trim_threshold(size_t threshold)
+{
+    trim_threshold = threshold;
+}
+
+/*
+ * realloc: resizes the block at ptr in place when possible, otherwise moves it
+ */
+void *realloc(void *ptr, size_t size)
+{
+    size_t adjsize, cursize;
+    char *newptr;
+    if (ptr == NULL) {
+        return malloc(size);
+    }
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    adjsize = adjust_size(size);
+    cursize = getSize(getHeaderAddress(ptr));
+    // shrink in place, the tail (if big enough) is given back as a free block
+    if (adjsize <= cursize) {
+        spin_lock(&heap_lock);
+        shrink_block(ptr, adjsize);
+        spin_unlock(&heap_lock);
+        return ptr;
+    }
+    // grow in place by absorbing the next block or extending the heap
+    spin_lock(&heap_lock);
+    if (grow_block(ptr, adjsize)) {
+        spin_unlock(&heap_lock);
+        return ptr;
+    }
+    spin_unlock(&heap_lock);
+    // no room around the block, move it
+    if ((newptr = malloc(size)) == NULL) {
+        return NULL;
+    }
+    memcpy(newptr, ptr, cursize - HDRSIZE);
+    free(ptr);
+    return newptr;
+}
+
+/*
+ * calloc: allocates a zeroed array of nmemb elements of given size
+ */
+void *calloc(size_t nmemb, size_t size)
+{
+    void *ptr;
+    // check for multiplication overflow
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        return NULL;
+    }
+    if ((ptr = malloc(nmemb * size)) != NULL) {
+        memset(ptr, 0, nmemb * size);
+    }
+    return ptr;
+}
+
+/*
+ * aligned_alloc: allocates size bytes at an address that is a multiple of alignment
+ * (a power of two), e.g. page-aligned memory for page tables
+ */
+void *aligned_alloc(size_t alignment, size_t size)
+{
+    char *ptr, *aligned;
+    size_t cursize, gap;
+    char prev_alloc;
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    if (alignment <= ALIGNMENT) {
+        return malloc(size);
+    }
+    if (size == 0 || size > SIZE_MAX - alignment - MINBLOCKSIZE - DHDRSIZE) {
+        return NULL;
+    }
+    // over-allocate so that an aligned payload with room for a free block in front fits
+    this_tcache()->mallocs++;
+    spin_lock(&heap_lock);
+    if ((ptr = alloc_block(adjust_size(size + alignment + MINBLOCKSIZE))) == NULL) {
+        spin_unlock(&heap_lock);
+        return NULL;
+    }
+    aligned = ptr;
+    if (((uintptr_t) ptr & (alignment - 1)) != 0) {
+        aligned = (char *) (((uintptr_t) ptr + MINBLOCKSIZE + alignment - 1) & ~(alignment - 1));
+        gap = aligned - ptr;
+        cursize = getSize(getHeaderAddress(ptr));
+        prev_alloc = getPrevAllocation(getHeaderAddress(ptr)) != 0;
+        // give the space in front of the aligned payload back as a free block
+        putW(getHeaderAddress(ptr), packW(gap, prev_alloc, 0));
+        putW(getFooterAddress(ptr), packW(gap, prev_alloc, 0));
+        putW(getHeaderAddress(aligned), packW(cursize - gap, 0, 1));
+        coalesce(ptr);
+    }
+    // and the space behind it
+    shrink_block(aligned, adjust_size(size));
+    spin_unlock(&heap_lock);
+    return aligned;
+}
+
+/*
+ * coalesce: Merges free block with previous and next block if possible,
+ * the neighbours are taken off their free lists and the result is inserted
  */
 static void *coalesce(void *ptr){
     void *next = getNextBlock(ptr);
-    void *prev = getPreviousBlock(ptr);
-    size_t prev_allocation = getAllocation(getFooterAddress(prev));
+    void *prev;
+    size_t prev_allocation = getPrevAllocation(getHeaderAddress(ptr));
     size_t next_allocation = getAllocation(getHeaderAddress(next));
     size_t size = getSize(getHeaderAddress(ptr));   // size of current block
     /* Check if it is possible to coalesce */
-    // Case 1 - previous and next blocks are not free: nothing to do
+    // Case 1 - previous and next blocks are not free: nothing to merge
     if (prev_allocation && next_allocation){
+        insert_free_block(ptr);
         return ptr;
     }
     // Case 2 - previous block not free, next block is free: expand current block into next
     else if (prev_allocation && !next_allocation) {
+        remove_free_block(next);
         size += getSize(getHeaderAddress(next));
-        putW(getFooterAddress(next),packW(size,0));
-        putW(getHeaderAddress(ptr), packW(size,0));
+        putW(getFooterAddress(next),packW(size,1,0));
+        putW(getHeaderAddress(ptr), packW(size,1,0));
+        insert_free_block(ptr);
+        return ptr;
     }
+    // the previous block is free, so its footer is valid and gives its address
+    prev = getPreviousBlock(ptr);
     // Case 3 - previous block is free, next block is not: expand previous block into current
-    else if (!prev_allocation && next_allocation){
+    if (next_allocation){
+        remove_free_block(prev);
         size += getSize(getHeaderAddress(prev));
-        putW(getHeaderAddress(prev), packW(size,0));
-        putW(getFooterAddress(ptr), packW(size,0));
+        putW(getHeaderAddress(prev), packW(size,1,0));
+        putW(getFooterAddress(ptr), packW(size,1,0));
         ptr = prev;
     }
     // Case 4 - previous and next blocks are free: expand previous block into next
     else {
+        remove_free_block(prev);
+        remove_free_block(next);
         size += getSize(getHeaderAddress(prev)) + getSize(getHeaderAddress(next));
-        putW(getHeaderAddress(prev), packW(size,0));
-        putW(getFooterAddress(next), packW(size,0));
+        putW(getHeaderAddress(prev), packW(size,1,0));
+        putW(getFooterAddress(next), packW(size,1,0));
         ptr = prev;
     }
+    insert_free_block(ptr);
     return ptr;
 }
 /*
@@ -183,36 +476,40 @@ static void *extend_heap(size_t words){
     size_t size;
     //Adjust size to make sure alignment is correct
     size = (words % 2) ? (words + 1) * HDRSIZE : words * HDRSIZE;
+    counters.sbrk_calls++;
     if ((long) (ptr = mem_sbrk(size)) == -1){
         return NULL;
     }
-    //Initialize header/footer in new block and epilogue header
-    putW(getHeaderAddress(ptr), packW(size, 0));           // free block header
-    putW(getFooterAddress(ptr), packW(size, 0));           // free block footer
-    putW(getHeaderAddress(getNextBlock(ptr)), packW(0,1)); // new epilogue header
+    //Initialize header/footer in new block and epilogue header,
+    //the old epilogue header becomes the new block header and knows about the last block
+    char prev_alloc = getPrevAllocation(getHeaderAddress(ptr)) != 0;
+    putW(getHeaderAddress(ptr), packW(size, prev_alloc, 0));   // free block header
+    putW(getFooterAddress(ptr), packW(size, prev_alloc, 0));   // free block footer
+    putW(getHeaderAddress(getNextBlock(ptr)), packW(0,0,1));   // new epilogue header
     // check if there are blocks to coalesce (the previous last block might be free)
     return coalesce(ptr);
 }
 /*
- * find_fit: loops through all blocks to find a free one that fits requested size heap size
+ * find_fit: searches the free lists starting from the size class of the request;
+ * within its own class a block may still be too small, so that list is walked
+ * first-fit, while any block of a larger class is big enough
  */
 static void *find_fit(size_t size) {
     char *currentp;
-    size_t currentsize;
-
-    // start traversing the implicit list starting from the first block (after prologue)
-    currentp = getNextBlock(heap_listp);
-    while (getSize(getHeaderAddress(currentp)) > 0) {
-        currentsize  = getSize(getHeaderAddress(currentp));
-        if (currentsize <= 0){  // search reached the epilogue block
-            return NULL;
+    int cls = getClass(size);
+
+    counters.searches++;
+    for (currentp = seg_lists[cls]; currentp != NULL; currentp = getSucc(currentp)) {
+        counters.search_steps++;
+        if (getSize(getHeaderAddress(currentp)) >= size) {
+            return currentp;
         }
-        if (getAllocation(getHeaderAddress(currentp)) == 0) {  // make sure block is free
-            if (currentsize >=  size) {
-                return currentp;
-            }
+    }
+    for (cls++; cls < NUM_CLASSES; cls++) {
+        if (seg_lists[cls] != NULL) {
+            counters.search_steps++;
+            return seg_lists[cls];
         }
-        currentp = getNextBlock(currentp);
     }
     return NULL;
 }
@@ -221,21 +518,304 @@ static void *find_fit(size_t size) {
  */
 static void place(void *ptr, size_t size){
     size_t freesize = getSize(getHeaderAddress(ptr));
+    char prev_alloc = getPrevAllocation(getHeaderAddress(ptr)) != 0;
+    remove_free_block(ptr);
+    counters.alloc_blocks++;
     // check if the size of the free block given is big enough to split after taking the requested bytes
-    if ((freesize - size) >  2*DHDRSIZE) {   // a block min size is 2*16 to fit hdr, ftr and payload
-        // split free block into 2 blocks
+    if ((freesize - size) >= MINBLOCKSIZE) {    // the remainder must fit hdr, ftr and list links
+        // split free block into 2 blocks, the allocated one has no footer
         void *newptr = ptr + size;
-        putW(getHeaderAddress(newptr), packW((freesize - size), 0));
-        putW(getFooterAddress(newptr), packW((freesize - size), 0));
-        putW(getHeaderAddress(ptr), packW(size, 1));
-        putW(getFooterAddress(ptr), packW(size, 1));
+        putW(getHeaderAddress(ptr), packW(size, prev_alloc, 1));
+        putW(getHeaderAddress(newptr), packW((freesize - size), 1, 0));
+        putW(getFooterAddress(newptr), packW((freesize - size), 1, 0));
+        insert_free_block(newptr);
     }
     else {
-        // take the whole free block
-        putW(getHeaderAddress(ptr), packW(freesize, 1));
-        putW(getFooterAddress(ptr), packW(freesize, 1));
+        // take the whole free block and tell the next block its predecessor is in use
+        putW(getHeaderAddress(ptr), packW(freesize, prev_alloc, 1));
+        setPrevAllocation(getHeaderAddress(getNextBlock(ptr)), 1);
     }
 }
+/*
+ * adjust_size: the block size for a request, including space for the header and alignment correction
+ */
+static size_t adjust_size(size_t size){
+    size_t adjsize = align(size + HDRSIZE);
+    if (adjsize < MINBLOCKSIZE) {
+        adjsize = MINBLOCKSIZE;                 // must hold the list links once freed
+    }
+    return adjsize;
+}
+/*
+ * shrink_block: cuts an allocated block down to size bytes if the tail can form a free block
+ */
+static void shrink_block(char *ptr, size_t size){
+    size_t cursize = getSize(getHeaderAddress(ptr));
+    char *tail;
+    if (cursize - size < MINBLOCKSIZE) {
+        return;
+    }
+    tail = ptr + size;
+    putW(getHeaderAddress(ptr), packW(size, getPrevAllocation(getHeaderAddress(ptr)) != 0, 1));
+    putW(getHeaderAddress(tail), packW(cursize - size, 1, 0));
+    putW(getFooterAddress(tail), packW(cursize - size, 1, 0));
+    setPrevAllocation(getHeaderAddress(getNextBlock(tail)), 0);
+    trim_heap(coalesce(tail));
+}
+/*
+ * grow_block: grows an allocated block to at least size bytes by absorbing the next
+ * block if it is free, the heap is extended first when the block is the last one
+ */
+static bool grow_block(char *ptr, size_t size){
+    size_t cursize = getSize(getHeaderAddress(ptr));
+    size_t avail = cursize;
+    size_t extendsize;
+    char *next = getNextBlock(ptr);
+    char *last = next;
+    if (!getAllocation(getHeaderAddress(next))) {
+        avail += getSize(getHeaderAddress(next));
+        last = getNextBlock(next);
+    }
+    if (avail < size) {
+        // only room at the end of the heap can be extended
+        if (getSize(getHeaderAddress(last)) != 0) {
+            return false;
+        }
+        extendsize = (size - avail > CHUNKSIZE) ? (size - avail) : CHUNKSIZE;
+        if (extend_heap(extendsize/HDRSIZE) == NULL) {
+            return false;
+        }
+        // the new space was coalesced with the free block following ptr (if any)
+        next = getNextBlock(ptr);
+        avail = cursize + getSize(getHeaderAddress(next));
+    }
+    remove_free_block(next);
+    putW(getHeaderAddress(ptr), packW(avail, getPrevAllocation(getHeaderAddress(ptr)) != 0, 1));
+    setPrevAllocation(getHeaderAddress(getNextBlock(ptr)), 1);
+    shrink_block(ptr, size);
+    return true;
+}
+/*
+ * trim_heap: if the free block ptr is the last one and larger than the trim threshold,
+ * keeps CHUNKSIZE bytes of it and shrinks the heap by the rest
+ */
+static void trim_heap(char *ptr){
+    size_t size = getSize(getHeaderAddress(ptr));
+    size_t release;
+    char prev_alloc;
+    if (size <= trim_threshold || size <= CHUNKSIZE || getSize(getHeaderAddress(getNextBlock(ptr))) != 0) {
+        return;
+    }
+    release = size - CHUNKSIZE;
+    counters.sbrk_calls++;
+    if ((long) mem_sbrk(-(intptr_t) release) == -1) {
+        return;
+    }
+    // the block stays free but moves to the free list of its new size
+    prev_alloc = getPrevAllocation(getHeaderAddress(ptr)) != 0;
+    remove_free_block(ptr);
+    putW(getHeaderAddress(ptr), packW(CHUNKSIZE, prev_alloc, 0));
+    putW(getFooterAddress(ptr), packW(CHUNKSIZE, prev_alloc, 0));
+    putW(getHeaderAddress(getNextBlock(ptr)), packW(0,0,1));   // new epilogue header
+    insert_free_block(ptr);
+}
+/*
+ * this_tcache: returns the cache of the executing CPU
+ */
+static struct tcache *this_tcache(void){
+#ifdef MM_TCACHE
+    return &tcaches[cpu_id()];
+#else
+    return &tcaches[0];
+#endif
+}
+/*
+ * tcache_bin: returns this CPU's cache bin for blocks of given size, NULL if too large
+ * to cache or if the caches are not built (MM_TCACHE)
+ */
+static struct tcache_bin *tcache_bin(struct tcache *tc, size_t size){
+#ifdef MM_TCACHE
+    if (size > TCACHE_MAX_SIZE) {
+        return NULL;
+    }
+    return &tc->bins[size / ALIGNMENT - 2];
+#else
+    return NULL;
+#endif
+}
+/*
+ * tcache_refill: fills an empty bin with TCACHE_BATCH blocks of at least size bytes
+ */
+static void tcache_refill(struct tcache_bin *bin, size_t size){
+    char *ptr;
+    spin_lock(&heap_lock);
+    while (bin->count < TCACHE_BATCH && (ptr = alloc_block(size)) != NULL) {
+        *(char **)ptr = bin->head;
+        bin->head = ptr;
+        bin->count++;
+    }
+    spin_unlock(&heap_lock);
+}
+/*
+ * tcache_drain: returns TCACHE_BATCH blocks of a full bin to the heap
+ */
+static void tcache_drain(struct tcache_bin *bin){
+    char *ptr;
+    spin_lock(&heap_lock);
+    while (bin->count > TCACHE_BIN_LIMIT - TCACHE_BATCH) {
+        ptr = bin->head;
+        bin->head = *(char **)ptr;
+        bin->count--;
+        free_block(ptr);
+    }
+    spin_unlock(&heap_lock);
+}
+/*
+ * insert_free_block: pushes a free block at the head of its size class list
+ */
+static void insert_free_block(char *ptr){
+    int cls = getClass(getSize(getHeaderAddress(ptr)));
+    setPred(ptr, NULL);
+    setSucc(ptr, seg_lists[cls]);
+    if (seg_lists[cls] != NULL) {
+        setPred(seg_lists[cls], ptr);
+    }
+    seg_lists[cls] = ptr;
+    counters.free_bytes += getSize(getHeaderAddress(ptr));
+    counters.free_blocks[cls]++;
+}
+/*
+ * remove_free_block: unlinks a free block from its size class list
+ */
+static void remove_free_block(char *ptr){
+    char *pred = getPred(ptr);
+    char *succ = getSucc(ptr);
+    size_t size = getSize(getHeaderAddress(ptr));
+    if (pred != NULL) {
+        setSucc(pred, succ);
+    } else {
+        seg_lists[getClass(size)] = succ;
+    }
+    counters.free_bytes -= size;
+    counters.free_blocks[getClass(size)]--;
+    if (succ != NULL) {
+        setPred(succ, pred);
+    }
+}
+
+/*
+ * mm_get_stats: takes a snapshot of the allocator counters
+ */
+void mm_get_stats(struct mm_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    spin_lock(&heap_lock);
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        struct tcache *tc = &tcaches[cpu];
+        stats->mallocs += tc->mallocs;
+        stats->frees += tc->frees;
+        stats->cache_hits += tc->hits;
+        for (int i = 0; i < TCACHE_BINS; i++) {
+            for (char *p = tc->bins[i].head; p != NULL; p = *(char **)p) {
+                stats->cached_blocks++;
+                stats->cached_bytes += getSize(getHeaderAddress(p));
+            }
+        }
+    }
+    stats->heap_bytes = (char *) mem_heap_hi() + 1 - (char *) mem_heap_lo();
+    stats->free_bytes = counters.free_bytes;
+    stats->used_bytes = stats->heap_bytes - counters.free_bytes - 4*HDRSIZE;  // minus padding, prologue, epilogue
+    stats->alloc_blocks = counters.alloc_blocks;
+    memcpy(stats->free_blocks, counters.free_blocks, sizeof(stats->free_blocks));
+    stats->sbrk_calls = counters.sbrk_calls;
+    stats->searches = counters.searches;
+    stats->search_steps = counters.search_steps;
+    spin_unlock(&heap_lock);
+}
 
+#ifdef MM_DEBUG
+/*
+ * mm_checkheap: walks the whole heap and all free lists and verifies the
+ * invariants of the block format, returns false (printing what is wrong
+ * if verbose) when the heap is corrupted
+ */
+#define CHECK(cond, ...) do {               \
+    if (!(cond)) {                          \
+        if (verbose) {                      \
+            printf("mm_checkheap: ");       \
+            printf(__VA_ARGS__);            \
+            printf("\n");                   \
+        }                                   \
+        ok = false;                         \
+    }                                       \
+} while (0)
 
+bool mm_checkheap(bool verbose)
+{
+    bool ok = true;
+    char *lo = mem_heap_lo(), *hi = (char *) mem_heap_hi() + 1;
+    char *ptr;
+    size_t size, walk_free = 0, list_free = 0;
+    char prev_alloc = 1;
 
+    spin_lock(&heap_lock);
+    // prologue
+    CHECK(getW(heap_listp - HDRSIZE) == packW(DHDRSIZE, 1, 1) && getW(heap_listp) == getW(heap_listp - HDRSIZE),
+          "bad prologue");
+    // every block from the prologue to the epilogue
+    for (ptr = getNextBlock(heap_listp); (size = getSize(getHeaderAddress(ptr))) != 0; ptr = getNextBlock(ptr)) {
+        CHECK(((uintptr_t) ptr & (ALIGNMENT - 1)) == 0, "block %p is not aligned", ptr);
+        CHECK(size >= MINBLOCKSIZE && (size & (ALIGNMENT - 1)) == 0, "block %p has bad size %zu", ptr, size);
+        CHECK(ptr + size <= hi, "block %p runs past the heap end", ptr);
+        CHECK((getPrevAllocation(getHeaderAddress(ptr)) != 0) == prev_alloc,
+              "block %p has a wrong prev-alloc bit", ptr);
+        if (!ok || ptr + size > hi) {
+            break;
+        }
+        if (!getAllocation(getHeaderAddress(ptr))) {
+            CHECK(getW(getHeaderAddress(ptr)) == getW(getFooterAddress(ptr)),
+                  "free block %p: header and footer differ", ptr);
+            CHECK(prev_alloc, "free blocks %p and %p were not coalesced", getPreviousBlock(ptr), ptr);
+            walk_free++;
+        }
+        prev_alloc = getAllocation(getHeaderAddress(ptr)) != 0;
+    }
+    // epilogue
+    if (ok) {
+        CHECK(getHeaderAddress(ptr) == hi - HDRSIZE, "epilogue at %p, the heap ends at %p", ptr, hi);
+        CHECK(getAllocation(getHeaderAddress(ptr)), "epilogue is not allocated");
+        CHECK((getPrevAllocation(getHeaderAddress(ptr)) != 0) == prev_alloc, "epilogue has a wrong prev-alloc bit");
+    }
+    // free lists
+    for (int cls = 0; cls < NUM_CLASSES; cls++) {
+        char *pred = NULL;
+        for (ptr = seg_lists[cls]; ok && ptr != NULL; pred = ptr, ptr = getSucc(ptr)) {
+            CHECK(ptr > lo && ptr < hi, "free list %d points outside the heap (%p)", cls, ptr);
+            if (!ok) {
+                break;
+            }
+            CHECK(!getAllocation(getHeaderAddress(ptr)), "allocated block %p on free list %d", ptr, cls);
+            CHECK(getClass(getSize(getHeaderAddress(ptr))) == cls, "block %p is on the wrong free list %d", ptr, cls);
+            CHECK(getPred(ptr) == pred, "block %p has a broken pred link", ptr);
+            list_free++;
+        }
+    }
+    CHECK(!ok || walk_free == list_free, "%zu free blocks in the heap, %zu on the free lists", walk_free, list_free);
+    // per-CPU caches only hold allocated blocks
+    for (int cpu = 0; ok && cpu < MAX_CPUS; cpu++) {
+        for (int i = 0; i < TCACHE_BINS; i++) {
+            for (ptr = tcaches[cpu].bins[i].head; ok && ptr != NULL; ptr = *(char **)ptr) {
+                CHECK(ptr > lo && ptr < hi && getAllocation(getHeaderAddress(ptr)),
+                      "bad block %p in the cache of CPU %d", ptr, cpu);
+            }
+        }
+    }
+    spin_unlock(&heap_lock);
+    return ok;
+}
+#else
+bool mm_checkheap(bool verbose)
+{
+    return true;
+}
+#endif
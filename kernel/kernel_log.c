@@ -0,0 +1,119 @@
+/*
+ * kernel_log.c - the kernel log ring
+ *
+ * Writers reserve their bytes with one atomic add on LogReserved, copy
+ * them in and add their length to LogFinished; none of them ever waits.
+ * When a writer finds that all reserved bytes are finished, nobody else is
+ * writing and it moves LogCommitted, the end of what readers may see, up
+ * to that point. Old bytes are overwritten, readers copy what they need
+ * and then drop whatever LogReserved shows was reserved again meanwhile.
+ */
+
+#include <log.h>
+#include <types.h>
+#include <fb.h>
+#include <string.h>
+#include <syscall.h>
+#include <vmm.h>
+
+static char LogBuf[LOG_SIZE] = { 0 };
+static uint64_t LogReserved = 0;	/* bytes reserved by writers */
+static uint64_t LogFinished = 0;	/* bytes copied in by writers */
+static uint64_t LogCommitted = 0;	/* bytes completely written */
+static uint64_t LogDrained = 0;		/* bytes shown on the console */
+static bool LogDraining = false;
+static bool LogDeferred = false;
+
+void log_write(const char *buf, size_t len)
+{
+	uint64_t pos, done, committed;
+	size_t off, first;
+
+	if (len > LOG_SIZE) {
+		buf += len - LOG_SIZE;
+		len = LOG_SIZE;
+	}
+	pos = __atomic_fetch_add(&LogReserved, len, __ATOMIC_RELAXED);
+	off = pos % LOG_SIZE;
+	first = len < LOG_SIZE - off ? len : LOG_SIZE - off;
+	memcpy(LogBuf + off, buf, first);
+	memcpy(LogBuf, buf + first, len - first);
+
+	done = __atomic_add_fetch(&LogFinished, len, __ATOMIC_ACQ_REL);
+	if (done == __atomic_load_n(&LogReserved, __ATOMIC_ACQUIRE)) {
+		committed = __atomic_load_n(&LogCommitted, __ATOMIC_RELAXED);
+		while (committed < done && !__atomic_compare_exchange_n(&LogCommitted,
+				&committed, done, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {}
+	}
+
+	if (!LogDeferred || pos + len - __atomic_load_n(&LogDrained, __ATOMIC_RELAXED) > LOG_SIZE / 2)
+		log_drain();
+}
+
+// Copy the committed bytes [pos, pos + len) to 'buf' and return how many
+// of the first ones were overwritten by writers during the copy
+static size_t log_copy(char *buf, uint64_t pos, size_t len)
+{
+	size_t off = pos % LOG_SIZE, first = len < LOG_SIZE - off ? len : LOG_SIZE - off;
+	uint64_t reserved;
+
+	memcpy(buf, LogBuf + off, first);
+	memcpy(buf + first, LogBuf, len - first);
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	reserved = __atomic_load_n(&LogReserved, __ATOMIC_RELAXED);
+	if (reserved <= LOG_SIZE || reserved - LOG_SIZE <= pos)
+		return 0;
+	return reserved - LOG_SIZE - pos < len ? reserved - LOG_SIZE - pos : len;
+}
+
+void log_drain(void)
+{
+	char buf[256];
+
+	// one drainer at a time, the current one sees the new bytes
+	if (__atomic_exchange_n(&LogDraining, true, __ATOMIC_ACQUIRE))
+		return;
+	while (1) {
+		uint64_t end = __atomic_load_n(&LogCommitted, __ATOMIC_ACQUIRE);
+		uint64_t pos = LogDrained;
+		size_t len, lost;
+
+		if (pos == end)
+			break;
+		if (end - pos > LOG_SIZE)	// overwritten before it was shown
+			pos = end - LOG_SIZE;
+		len = end - pos < sizeof(buf) ? end - pos : sizeof(buf);
+		lost = log_copy(buf, pos, len);
+		fb_write(buf + lost, len - lost);
+		__atomic_store_n(&LogDrained, pos + len, __ATOMIC_RELAXED);
+	}
+	fb_flush();
+	__atomic_store_n(&LogDraining, false, __ATOMIC_RELEASE);
+}
+
+void log_defer(void)
+{
+	LogDeferred = true;
+}
+
+size_t log_read(char *buf, size_t len)
+{
+	uint64_t end = __atomic_load_n(&LogCommitted, __ATOMIC_ACQUIRE);
+	size_t lost;
+
+	if (len > LOG_SIZE)
+		len = LOG_SIZE;
+	if (len > end)
+		len = end;
+	// the oldest bytes may be overwritten while copying, try the newer ones
+	while ((lost = log_copy(buf, end - len, len)) != 0)
+		len -= lost;
+	return len;
+}
+
+long sys_dmesg(char *buf, size_t len)
+{
+	if (!vmm_user_range(vmm_current_space(), buf, len, VMM_WRITE))
+		return -1;
+	return (long) log_read(buf, len);
+}
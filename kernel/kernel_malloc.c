@@ -21,13 +21,21 @@ void mem_init(void *heapMemory, size_t heapMemorySize)
 	HeapMemoryEnd = heapMemory + heapMemorySize;
 }
 
+/*
+ * Moves the break by incr bytes and returns the old break,
+ * a negative incr gives memory back to the heap region
+ */
 void *mem_sbrk(intptr_t incr)
 {
 	void *prevBrk = HeapMemoryBrk;
-	if (prevBrk + incr > HeapMemoryEnd) {
+	if (incr > HeapMemoryEnd - prevBrk) {
 		printf("ERROR: Allocated too much memory!\n");
 		return (void *) -1;
 	}
+	if (incr < HeapMemory - prevBrk) {
+		printf("ERROR: Released too much memory!\n");
+		return (void *) -1;
+	}
 	HeapMemoryBrk += incr;
 	return prevBrk;
 }
@@ -45,7 +53,6 @@ void *mem_heap_hi()
 void mem_extra_test()
 {
 	size_t i;
-	mm_init();
 	void *p1 = malloc(1024);
 	if (!p1) {
 		printf("Extra Credit: 0/40 points\n\n");
@@ -72,5 +79,9 @@ void mem_extra_test()
 		}
 	}
 	free(p3);
+	if (!mm_checkheap(true)) {
+		printf("ERROR: heap check failed\n");
+		while (1) {}
+	}
 	printf("Extra Credit: 40/40 points\n\n");
 }
@@ -0,0 +1,158 @@
+/*
+ * kernel_page.c - buddy allocator for physical page frames
+ *
+ * The managed range is split into naturally aligned blocks of 2^order
+ * pages. Free blocks of every order are kept in a doubly linked list
+ * threaded through the free pages themselves, and one byte per page
+ * (stored at the start of the range) records the order of a block and
+ * whether it is free, so that page_free() finds the buddy of a block,
+ * the block at index ^ 2^order, in O(1) and merges while it is free.
+ */
+
+#include <page.h>
+#include <types.h>
+#include <spinlock.h>
+
+#define PAGE_FREE	0x80	/* page_info: the head of a free block */
+#define PAGE_ORDER	0x1F	/* page_info: the order of the block */
+
+struct free_block {
+	struct free_block *next;
+	struct free_block *prev;
+};
+
+static struct free_block *FreeLists[PAGE_MAX_ORDER + 1] = { NULL };
+static uint8_t *PageInfo = NULL;	/* one byte per managed page */
+static char *PageBase = NULL;		/* the first managed page */
+static size_t PageCount = 0;		/* the number of managed pages */
+static size_t FreePages = 0;
+static spinlock_t PageLock = SPINLOCK_INIT;
+
+static inline size_t page_index(void *page)
+{
+	return ((char *) page - PageBase) >> PAGE_SHIFT;
+}
+
+static inline struct free_block *page_block(size_t index)
+{
+	return (struct free_block *) (PageBase + (index << PAGE_SHIFT));
+}
+
+static void free_list_push(size_t index, unsigned int order)
+{
+	struct free_block *block = page_block(index);
+
+	block->prev = NULL;
+	block->next = FreeLists[order];
+	if (block->next)
+		block->next->prev = block;
+	FreeLists[order] = block;
+	PageInfo[index] = PAGE_FREE | order;
+}
+
+static void free_list_remove(size_t index, unsigned int order)
+{
+	struct free_block *block = page_block(index);
+
+	if (block->prev)
+		block->prev->next = block->next;
+	else
+		FreeLists[order] = block->next;
+	if (block->next)
+		block->next->prev = block->prev;
+	PageInfo[index] = order;
+}
+
+void page_init(void *memory, size_t memorySize)
+{
+	uintptr_t start = ((uintptr_t) memory + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	uintptr_t end = ((uintptr_t) memory + memorySize) & ~(PAGE_SIZE - 1);
+	size_t pages, info_pages, index;
+	unsigned int order;
+
+	for (order = 0; order <= PAGE_MAX_ORDER; order++)
+		FreeLists[order] = NULL;
+	FreePages = 0;
+	PageCount = 0;
+	if (end <= start)
+		return;
+
+	/* Carve the page_info array out of the beginning of the range */
+	pages = (end - start) >> PAGE_SHIFT;
+	info_pages = (pages + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	if (info_pages >= pages)
+		return;
+	PageInfo = (uint8_t *) start;
+	PageBase = (char *) start + (info_pages << PAGE_SHIFT);
+	PageCount = pages - info_pages;
+
+	/* Free the rest as the largest naturally aligned blocks that fit */
+	for (index = 0; index < PageCount; index += (1UL << order)) {
+		order = index ? __builtin_ctzl(index) : PAGE_MAX_ORDER;
+		if (order > PAGE_MAX_ORDER)
+			order = PAGE_MAX_ORDER;
+		while (index + (1UL << order) > PageCount)
+			order--;
+		free_list_push(index, order);
+		FreePages += 1UL << order;
+	}
+}
+
+void *page_alloc(unsigned int order)
+{
+	unsigned int cur;
+	size_t index;
+
+	if (order > PAGE_MAX_ORDER)
+		return NULL;
+
+	spin_lock(&PageLock);
+	for (cur = order; cur <= PAGE_MAX_ORDER && !FreeLists[cur]; cur++) {}
+	if (cur > PAGE_MAX_ORDER) {
+		spin_unlock(&PageLock);
+		return NULL;
+	}
+	index = page_index(FreeLists[cur]);
+	free_list_remove(index, cur);
+
+	/* Split the block, the upper halves go back to the free lists */
+	while (cur > order) {
+		cur--;
+		free_list_push(index + (1UL << cur), cur);
+	}
+	PageInfo[index] = order;
+	FreePages -= 1UL << order;
+	spin_unlock(&PageLock);
+
+	return page_block(index);
+}
+
+void page_free(void *page, unsigned int order)
+{
+	size_t index, buddy;
+
+	if (!page)
+		return;
+	index = page_index(page);
+
+	spin_lock(&PageLock);
+	FreePages += 1UL << order;
+
+	/* Merge with the buddy as long as it is a free block of the same order */
+	while (order < PAGE_MAX_ORDER) {
+		buddy = index ^ (1UL << order);
+		if (buddy + (1UL << order) > PageCount || !(PageInfo[buddy] & PAGE_FREE) ||
+				(PageInfo[buddy] & PAGE_ORDER) != order)
+			break;
+		free_list_remove(buddy, order);
+		index &= buddy;
+		order++;
+	}
+	free_list_push(index, order);
+	spin_unlock(&PageLock);
+}
+
+size_t page_free_count(void)
+{
+	return FreePages;
+}
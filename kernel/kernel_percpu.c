@@ -0,0 +1,23 @@
+/*
+ * kernel_percpu.c - identification of the executing CPU
+ */
+
+#include <percpu.h>
+#include <cpu.h>
+#include <msr.h>
+
+bool CpuHasRdtscp = false;
+
+void percpu_init(unsigned int cpu)
+{
+	uint32_t eax, ebx, ecx, edx;
+
+	cpuid(CPUID_EXT_MAX, 0, &eax, &ebx, &ecx, &edx);
+	if (eax < CPUID_EXT_FEATURES)
+		return;
+	cpuid(CPUID_EXT_FEATURES, 0, &eax, &ebx, &ecx, &edx);
+	if (edx & CPUID_EXT_EDX_RDTSCP) {
+		wrmsr(MSR_TSC_AUX, cpu);
+		CpuHasRdtscp = true;
+	}
+}
@@ -0,0 +1,35 @@
+/*
+ * kernel_pt.c - bulk page table construction
+ *
+ * Entries are composed as whole 64-bit words once and then only advanced
+ * by the address step, so a run of entries is written with plain stores
+ * (two entries per 16-byte store) rather than a read-modify-write of every
+ * bitfield of every entry.
+ */
+
+#include <paging.h>
+#include <types.h>
+
+typedef uint64_t pte_pair_t __attribute__((vector_size(16)));
+
+void pt_fill(pte_t *table, size_t count, uint64_t addr, uint64_t step, pte_t flags)
+{
+	pte_t entry = PTE_MAKE(addr, flags);
+	size_t i = 0;
+
+	if (count >= 4 && ((uintptr_t) table & 15) == 0) {
+		pte_pair_t lo = { entry, entry + step };
+		pte_pair_t hi = { entry + 2 * step, entry + 3 * step };
+		pte_pair_t inc = { 4 * step, 4 * step };
+
+		for (; i + 4 <= count; i += 4) {
+			*(pte_pair_t *) &table[i] = lo;
+			*(pte_pair_t *) &table[i + 2] = hi;
+			lo += inc;
+			hi += inc;
+		}
+		entry += i * step;
+	}
+	for (; i < count; i++, entry += step)
+		table[i] = entry;
+}
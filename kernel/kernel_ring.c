@@ -0,0 +1,63 @@
+/*
+ * kernel_ring.c - batched system calls through a shared ring
+ */
+
+#include <ring.h>
+#include <syscall.h>
+#include <types.h>
+#include <page.h>
+#include <vmm.h>
+
+extern long kernel_status;
+
+/*
+ * Map a zeroed ring into the current address space, returns its address
+ * (also when it is already mapped) or -1
+ */
+long sys_ring_setup(void)
+{
+	if (vmm_user_range(vmm_current_space(), (void *) RING_USER_ADDR, PAGE_SIZE, VMM_WRITE))
+		return (long) RING_USER_ADDR;
+	if (vmm_reserve(vmm_current_space(), (void *) RING_USER_ADDR, PAGE_SIZE,
+			VMM_WRITE | VMM_USER) != 0)
+		return -1;
+	return (long) RING_USER_ADDR;
+}
+
+/*
+ * Run the queued system calls in order while there is room for their
+ * completions, returns the number of completions posted or -1 if 'ring'
+ * is not writable user memory
+ */
+long sys_ring_enter(struct syscall_ring *ring)
+{
+	uint32_t head, tail, cq_head, cq_tail;
+	long done = 0;
+
+	if (!vmm_user_range(vmm_current_space(), ring, sizeof(*ring), VMM_WRITE))
+		return -1;
+	head = ring->sq_head;
+	cq_tail = ring->cq_tail;
+	tail = __atomic_load_n(&ring->sq_tail, __ATOMIC_ACQUIRE);
+	cq_head = __atomic_load_n(&ring->cq_head, __ATOMIC_ACQUIRE);
+
+	// at most RING_ENTRIES per call, whatever the user wrote into the counters
+	while (head != tail && cq_tail - cq_head < RING_ENTRIES && done < RING_ENTRIES) {
+		struct ring_sqe sqe = ring->sq[head++ % RING_ENTRIES];
+		struct ring_cqe *cqe = &ring->cq[cq_tail++ % RING_ENTRIES];
+
+		cqe->user_data = sqe.user_data;
+		// the same results as the direct calls, except that rings do not nest
+		if (sqe.n == SYS_RING_ENTER)
+			cqe->result = -1;
+		else if (sqe.n == SYS_KERNEL_STATUS)
+			cqe->result = kernel_status;
+		else
+			cqe->result = syscall_call(sqe.n, sqe.args[0], sqe.args[1],
+				sqe.args[2], sqe.args[3], sqe.args[4]);
+		done++;
+	}
+	__atomic_store_n(&ring->sq_head, head, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->cq_tail, cq_tail, __ATOMIC_RELEASE);
+	return done;
+}
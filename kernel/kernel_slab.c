@@ -0,0 +1,123 @@
+/*
+ * kernel_slab.c - object caches for fixed-size kernel objects
+ *
+ * A cache takes slabs from aligned_alloc() and carves every slab into
+ * equally sized object slots. Free slots of all slabs are chained through their
+ * first word into one per-cache freelist, so kmem_cache_alloc() and
+ * kmem_cache_free() are O(1) and objects of one size never fragment the
+ * general heap. Slabs are only given back when the cache is destroyed.
+ * Objects start at the aligned base of a slab and the slab header follows
+ * the last object, so page-aligned caches do not lose a page to it.
+ */
+
+#include <slab.h>
+#include <malloc.h>
+#include <types.h>
+#include <string.h>
+
+#define SLAB_SIZE		4096	/* the default slab size */
+#define SLAB_MIN_OBJECTS	8	/* fit at least that many objects per slab */
+#define SLAB_MAX_ALIGN		4096	/* page-aligned objects, e.g. page tables */
+
+struct slab {
+	struct slab *next;	/* the header of the next slab of this cache */
+};
+
+struct kmem_cache {
+	const char *name;
+	size_t objsize;		/* object size, rounded up to the alignment */
+	size_t align;		/* slab and object alignment */
+	size_t header;		/* the slab header's offset, behind the last object */
+	size_t slabsize;	/* bytes requested from aligned_alloc() per slab */
+	size_t objects;		/* objects per slab */
+	void *freelist;		/* free slots of all slabs */
+	struct slab *slabs;	/* all slabs of the cache */
+	size_t active;		/* objects handed out */
+};
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t size, size_t align)
+{
+	kmem_cache_t *cache;
+
+	if (align < sizeof(void *))
+		align = sizeof(void *);
+	if (size == 0 || align > SLAB_MAX_ALIGN || (align & (align - 1)) != 0)
+		return NULL;
+	if (size < sizeof(void *))
+		size = sizeof(void *); /* a free slot holds the freelist link */
+
+	cache = malloc(sizeof(*cache));
+	if (!cache)
+		return NULL;
+	cache->name = name;
+	cache->objsize = (size + align - 1) & ~(align - 1);
+	cache->align = align;
+	cache->slabsize = SLAB_SIZE;
+	if (cache->slabsize < SLAB_MIN_OBJECTS * cache->objsize + sizeof(struct slab))
+		cache->slabsize = SLAB_MIN_OBJECTS * cache->objsize + sizeof(struct slab);
+	cache->objects = (cache->slabsize - sizeof(struct slab)) / cache->objsize;
+	cache->header = cache->objects * cache->objsize;
+	cache->freelist = NULL;
+	cache->slabs = NULL;
+	cache->active = 0;
+	return cache;
+}
+
+void kmem_cache_destroy(kmem_cache_t *cache)
+{
+	struct slab *slab, *next;
+
+	if (!cache)
+		return;
+	for (slab = cache->slabs; slab != NULL; slab = next) {
+		next = slab->next;
+		free((char *) slab - cache->header);
+	}
+	free(cache);
+}
+
+/* Get a new slab and thread all of its slots onto the freelist */
+static bool kmem_cache_grow(kmem_cache_t *cache)
+{
+	char *base = aligned_alloc(cache->align, cache->slabsize);
+	struct slab *slab;
+	char *obj;
+	size_t i;
+
+	if (!base)
+		return false;
+	slab = (struct slab *) (base + cache->header);
+	slab->next = cache->slabs;
+	cache->slabs = slab;
+
+	obj = base + (cache->objects - 1) * cache->objsize;
+	for (i = 0; i < cache->objects; i++) {
+		*(void **) obj = cache->freelist;
+		cache->freelist = obj;
+		obj -= cache->objsize;
+	}
+	return true;
+}
+
+void *kmem_cache_alloc(kmem_cache_t *cache)
+{
+	void *obj = cache->freelist;
+
+	if (!obj) {
+		if (!kmem_cache_grow(cache))
+			return NULL;
+		obj = cache->freelist;
+	}
+	cache->freelist = *(void **) obj;
+	cache->active++;
+	return obj;
+}
+
+void kmem_cache_free(kmem_cache_t *cache, void *obj)
+{
+	if (!obj)
+		return;
+	*(void **) obj = cache->freelist;
+	cache->freelist = obj;
+	cache->active--;
+}
@@ -0,0 +1,101 @@
+/*
+ * kernel_trap.c - the interrupt descriptor table and exception handlers
+ */
+
+#include <trap.h>
+#include <kernel.h>
+#include <types.h>
+#include <msr.h>
+#include <cpu.h>
+#include <vmm.h>
+#include <printf.h>
+#include <apic.h>
+#include <log.h>
+
+#define IDT_ENTRIES	256
+#define IDT_INTERRUPT	0x8E	/* present, DPL 0, 64-bit interrupt gate */
+#define TSS_AVAILABLE	0x89	/* present, DPL 0, 64-bit available TSS */
+
+struct idt_entry {
+	uint16_t offset_low;
+	uint16_t selector;
+	uint8_t ist;
+	uint8_t type;
+	uint16_t offset_mid;
+	uint32_t offset_high;
+	uint32_t reserved;
+} __attribute__((packed));
+
+struct tss {
+	uint32_t reserved0;
+	uint64_t rsp[3];	/* the stacks for a switch to ring 0-2 */
+	uint64_t reserved1;
+	uint64_t ist[7];
+	uint64_t reserved2;
+	uint16_t reserved3;
+	uint16_t iomap_base;
+} __attribute__((packed));
+
+struct table_ptr {
+	uint16_t limit;
+	uint64_t base;
+} __attribute__((packed));
+
+extern uint64_t gdt[]; /* kernel_entry.S */
+
+static struct idt_entry idt[IDT_ENTRIES] __attribute__((aligned(16))) = { { 0 } };
+static struct tss tss __attribute__((aligned(16))) = { 0 };
+
+static void idt_set(unsigned int vector, void *handler)
+{
+	uint64_t addr = (uint64_t) handler;
+
+	idt[vector].offset_low = addr & 0xFFFF;
+	idt[vector].selector = GDT_KERNEL_CODE;
+	idt[vector].ist = 0;
+	idt[vector].type = IDT_INTERRUPT;
+	idt[vector].offset_mid = (addr >> 16) & 0xFFFF;
+	idt[vector].offset_high = addr >> 32;
+	idt[vector].reserved = 0;
+}
+
+void trap_init(void)
+{
+	uint64_t base = (uint64_t) &tss, limit = sizeof(tss) - 1;
+	struct table_ptr idt_ptr;
+
+	/* Exceptions from user mode switch to the kernel stack */
+	tss.rsp[0] = (uint64_t) kernel_stack;
+	tss.iomap_base = sizeof(tss);
+	gdt[GDT_TSS / 8] = (limit & 0xFFFF) | ((base & 0xFFFFFF) << 16) |
+		((uint64_t) TSS_AVAILABLE << 40) | ((limit >> 16) << 48) |
+		((base >> 24 & 0xFF) << 56);
+	gdt[GDT_TSS / 8 + 1] = base >> 32;
+	__asm__ __volatile__ ("ltr %w0" : : "r" (GDT_TSS));
+
+	idt_set(VEC_PAGE_FAULT, page_fault_entry_ptr);
+	idt_set(VEC_TIMER, timer_entry_ptr);
+	idt_set(VEC_SPURIOUS, spurious_entry_ptr);
+	idt_ptr.limit = sizeof(idt) - 1;
+	idt_ptr.base = (uint64_t) idt;
+	__asm__ __volatile__ ("lidt %0" : : "m" (idt_ptr));
+}
+
+void page_fault_handler(struct trap_frame *tf)
+{
+	void *addr = (void *) read_cr2();
+
+	if (vmm_fault(addr, tf->error) == 0)
+		return;
+
+	printf("ERROR: page fault at %p (rip %p, error %llx)\n", addr,
+		(void *) tf->rip, tf->error);
+	log_drain();
+	while (1) {}
+}
+
+void timer_handler(struct trap_frame *tf)
+{
+	apic_eoi();
+	log_drain();
+}
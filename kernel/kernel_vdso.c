@@ -0,0 +1,99 @@
+/*
+ * kernel_vdso.c - kernel data published to user mode
+ */
+
+#include <vdso.h>
+#include <types.h>
+#include <cpu.h>
+#include <page.h>
+#include <string.h>
+#include <vmm.h>
+
+#define PIT_HZ		1193182
+#define PIT_CH2		0x42
+#define PIT_CMD		0x43
+#define PIT_GATE	0x61	/* bit 0: channel 2 gate, bit 5: channel 2 output */
+
+extern long kernel_status;
+
+static struct vdso_data *Vdso = NULL;
+
+// Count TSC cycles during 10 ms of PIT channel 2 in one-shot mode,
+// 0 if the PIT never fires
+static uint64_t pit_tsc_hz(void)
+{
+	uint16_t count = PIT_HZ / 100;
+	uint64_t start;
+
+	outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);
+	outb(PIT_CMD, 0xB0);		// channel 2, low/high byte, mode 0
+	outb(PIT_CH2, count & 0xFF);
+	outb(PIT_CH2, count >> 8);
+	start = rdtsc();
+	while (!(inb(PIT_GATE) & 0x20)) {
+		if (rdtsc() - start > (1ULL << 36))
+			return 0;
+	}
+	return (rdtsc() - start) * 100;
+}
+
+// CPUID reports the TSC frequency on recent CPUs, otherwise it is measured
+static uint64_t tsc_measure(void)
+{
+	uint32_t max, eax, ebx, ecx, edx;
+
+	cpuid(CPUID_MAX, 0, &max, &ebx, &ecx, &edx);
+	if (max >= CPUID_TSC) {
+		cpuid(CPUID_TSC, 0, &eax, &ebx, &ecx, &edx);
+		if (eax != 0 && ebx != 0 && ecx != 0)
+			return (uint64_t) ecx * ebx / eax;
+	}
+	if (max >= CPUID_FREQ) {
+		cpuid(CPUID_FREQ, 0, &eax, &ebx, &ecx, &edx);
+		if ((eax & 0xFFFF) != 0)
+			return (uint64_t) (eax & 0xFFFF) * 1000000;
+	}
+	return pit_tsc_hz();
+}
+
+uint64_t tsc_hz(void)
+{
+	static uint64_t hz = 0;
+	static bool known = false;
+
+	if (!known) {
+		hz = tsc_measure();
+		known = true;
+	}
+	return hz;
+}
+
+void vdso_init(void)
+{
+	Vdso = page_alloc(0);
+	if (Vdso == NULL)
+		return;
+	memset(Vdso, 0, PAGE_SIZE);
+	Vdso->tsc_hz = tsc_hz();
+	if (Vdso->tsc_hz != 0)
+		Vdso->ns_mult = (1000000000ULL << 32) / Vdso->tsc_hz;
+	Vdso->clock_tsc = rdtsc();
+	vdso_update();
+}
+
+void vdso_update(void)
+{
+	if (Vdso == NULL)
+		return;
+	__atomic_store_n(&Vdso->seq, Vdso->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	Vdso->kernel_status = kernel_status;
+	__atomic_store_n(&Vdso->seq, Vdso->seq + 1, __ATOMIC_RELEASE);
+}
+
+int vdso_map(address_space_t *space)
+{
+	if (Vdso == NULL)
+		return -1;
+	return vmm_map(space, (void *) VDSO_USER_ADDR, (uint64_t) Vdso, VMM_USER);
+}
@@ -0,0 +1,499 @@
+/*
+ * kernel_vmm.c - virtual memory manager
+ *
+ * Maps 4 KB pages into per-address-space page tables. Missing intermediate
+ * tables are allocated from the page frame allocator on the way down, so
+ * nothing is allocated for a virtual range until a page in it is mapped.
+ * vmm_reserve() only records a region; its pages are backed by zeroed
+ * frames from the page fault handler when they are first touched.
+ *
+ * All address spaces point their lower PML4 entries to the same tables.
+ * When a new kernel PML4 entry is filled in, it is copied to every address
+ * space, so the tables below it never need to be synchronized.
+ *
+ * With PCIDs, the TLB keeps the entries of an address space after a switch
+ * away from it. A mapping removed from an address space that is not current
+ * is invalidated with INVPCID if available; otherwise its whole PCID is
+ * flushed on the next switch to it, which is also done for a recycled PCID.
+ */
+
+#include <vmm.h>
+#include <types.h>
+#include <page.h>
+#include <paging.h>
+#include <slab.h>
+#include <string.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <msr.h>
+#include <vdso.h>
+
+#define VMM_PTE_OWNED	(1ULL << PTE_AVL_SHIFT)	/* the frame was allocated by vmm_fault() */
+
+/* #PF error code bits */
+#define PF_PRESENT	0x1	/* a protection violation, not a missing page */
+#define PF_WRITE	0x2
+#define PF_USER		0x4
+
+struct vmm_region {
+	uint64_t start;
+	uint64_t end;		/* 0 if the slot is free */
+	unsigned int flags;
+};
+
+struct address_space {
+	pte_t *pml4;
+	uint16_t pcid;
+	bool flush;		/* stale TLB entries may be tagged with 'pcid' */
+	struct address_space *next;	/* all address spaces */
+	struct address_space *prev;
+	struct vmm_region regions[VMM_MAX_REGIONS];	/* user half only */
+	uint64_t brk_start;	/* the user heap, a region from brk_start to brk */
+	uint64_t brk;
+};
+
+static struct address_space KernelSpace = { 0 };
+static struct address_space *Current = NULL;
+static kmem_cache_t *SpaceCache = NULL;
+static uint64_t PcidMap[VMM_MAX_PCID / 64] = { 1 };	/* PCID 0 is the kernel's */
+static bool PcidEnabled = false;
+static bool HasInvpcid = false;
+static pte_t NxBit = 0;		/* PTE_NX if EFER.NXE is set, for mappings without VMM_EXEC */
+static pte_t GlobalBit = 0;	/* PTE_GLOBAL if CR4.PGE is set, for kernel mappings */
+static spinlock_t VmmLock = SPINLOCK_INIT;
+
+void vmm_init(void *pml4)
+{
+	uint32_t eax, ebx, ecx, edx;
+	uint32_t max;
+
+	KernelSpace.pml4 = pml4;
+	KernelSpace.pcid = 0;
+	KernelSpace.next = &KernelSpace;
+	KernelSpace.prev = &KernelSpace;
+	Current = &KernelSpace;
+	SpaceCache = kmem_cache_create("address_space", sizeof(struct address_space), 64);
+	NxBit = (rdmsr(MSR_EFER) & EFER_NXE) ? PTE_NX : 0;
+	GlobalBit = (read_cr4() & CR4_PGE) ? PTE_GLOBAL : 0;
+
+	// CR4.PCIDE can only be set while the PCID in CR3 is 0
+	cpuid(CPUID_MAX, 0, &max, &ebx, &ecx, &edx);
+	cpuid(CPUID_FEATURES, 0, &eax, &ebx, &ecx, &edx);
+	if ((ecx & CPUID_ECX_PCID) && (read_cr3() & CR3_PCID_MASK) == 0) {
+		write_cr4(read_cr4() | CR4_PCIDE);
+		PcidEnabled = true;
+		if (max >= CPUID_FEATURES7) {
+			cpuid(CPUID_FEATURES7, 0, &eax, &ebx, &ecx, &edx);
+			HasInvpcid = (ebx & CPUID_7_EBX_INVPCID) != 0;
+		}
+	}
+}
+
+address_space_t *vmm_kernel_space(void)
+{
+	return &KernelSpace;
+}
+
+address_space_t *vmm_current_space(void)
+{
+	return Current;
+}
+
+static int pcid_alloc(void)
+{
+	for (int i = 0; i < VMM_MAX_PCID / 64; i++) {
+		if (PcidMap[i] != ~0ULL) {
+			int bit = __builtin_ctzll(~PcidMap[i]);
+			PcidMap[i] |= 1ULL << bit;
+			return i * 64 + bit;
+		}
+	}
+	return -1;
+}
+
+static void pcid_free(unsigned int pcid)
+{
+	PcidMap[pcid / 64] &= ~(1ULL << (pcid % 64));
+}
+
+/* Drop the TLB entry for 'virt' in 'space' */
+static void flush_page(struct address_space *space, uint64_t virt)
+{
+	if (space == Current)
+		invlpg((void *) virt);
+	else if (HasInvpcid)
+		invpcid(INVPCID_ADDRESS, space->pcid, (void *) virt);
+	else
+		space->flush = true;
+}
+
+/*
+ * The table that 'entry' points to, allocating it if 'create' is set;
+ * NULL if there is none or 'entry' maps a large page
+ */
+static pte_t *next_table(pte_t *entry, int create, int user)
+{
+	if (!(*entry & PTE_PRESENT)) {
+		if (!create)
+			return NULL;
+		void *table = page_alloc(0);
+		if (!table)
+			return NULL;
+		memset(table, 0, PAGE_SIZE);
+		*entry = PTE_MAKE(table, PTE_TABLE);
+	} else if (*entry & PTE_LARGE) {
+		return NULL;
+	}
+	// access rights are checked in the PTE, the upper levels only
+	// need to let user accesses through
+	if (user)
+		*entry |= PTE_USER;
+	return pte_table(*entry);
+}
+
+static pte_t *vmm_pte(struct address_space *space, uint64_t virt, int create, int user)
+{
+	unsigned int index = PML4_INDEX(virt);
+	pte_t *table;
+
+	table = next_table(&space->pml4[index], create, user);
+	if (table && create && index < PML4_KERNEL) {
+		// the kernel half is shared by all address spaces
+		for (struct address_space *s = KernelSpace.next; s != &KernelSpace; s = s->next)
+			s->pml4[index] = space->pml4[index];
+		KernelSpace.pml4[index] = space->pml4[index];
+	}
+	if (table)
+		table = next_table(&table[PDPT_INDEX(virt)], create, user);
+	if (table)
+		table = next_table(&table[PD_INDEX(virt)], create, user);
+	if (!table)
+		return NULL;
+	return &table[PT_INDEX(virt)];
+}
+
+/* Kernel half regions are kept by the kernel address space */
+static inline struct address_space *region_space(struct address_space *space, uint64_t virt)
+{
+	return PML4_INDEX(virt) < PML4_KERNEL ? &KernelSpace : space;
+}
+
+static int map_page(struct address_space *space, uint64_t virt, uint64_t phys,
+		    unsigned int flags, pte_t avl)
+{
+	pte_t *pte = vmm_pte(space, virt, 1, flags & VMM_USER);
+	pte_t bits = PTE_PRESENT | avl;
+
+	if (!pte || (*pte & PTE_PRESENT))
+		return -1;
+	if (flags & VMM_WRITE)
+		bits |= PTE_WRITABLE;
+	bits |= (flags & VMM_USER) ? PTE_USER : GlobalBit;
+	if (!(flags & VMM_EXEC))
+		bits |= NxBit;
+	*pte = PTE_MAKE(phys, bits);
+	return 0;
+}
+
+int vmm_map(address_space_t *space, void *virt, uint64_t phys, unsigned int flags)
+{
+	int ret;
+
+	if (((uint64_t) virt | phys) & (PAGE_SIZE - 1))
+		return -1;
+	spin_lock(&VmmLock);
+	ret = map_page(space, (uint64_t) virt, phys, flags,
+		       (flags & VMM_OWNED) ? VMM_PTE_OWNED : 0);
+	spin_unlock(&VmmLock);
+	return ret;
+}
+
+static void unmap_range(struct address_space *space, uint64_t start, uint64_t end)
+{
+	uint64_t virt = start;
+
+	while (virt < end) {
+		pte_t *pte = vmm_pte(space, virt, 0, 0);
+		if (!pte) {
+			// no page table below this PDE, skip all of its 2 MB
+			virt = (virt + (1UL << 21)) & ~((1UL << 21) - 1);
+			continue;
+		}
+		if (*pte & PTE_PRESENT) {
+			if (*pte & VMM_PTE_OWNED)
+				page_free((void *) PTE_ADDR(*pte), 0);
+			*pte = 0;
+			if (PML4_INDEX(virt) < PML4_KERNEL) {
+				flush_page(&KernelSpace, virt);
+				for (struct address_space *s = KernelSpace.next; s != &KernelSpace; s = s->next)
+					flush_page(s, virt);
+			} else {
+				flush_page(space, virt);
+			}
+		}
+		virt += PAGE_SIZE;
+	}
+}
+
+void vmm_unmap(address_space_t *space, void *virt, size_t size)
+{
+	uint64_t start = (uint64_t) virt & ~(PAGE_SIZE - 1);
+
+	spin_lock(&VmmLock);
+	unmap_range(space, start, (uint64_t) virt + size);
+	spin_unlock(&VmmLock);
+}
+
+int vmm_reserve(address_space_t *space, void *virt, size_t size, unsigned int flags)
+{
+	uint64_t start = (uint64_t) virt, end = start + size;
+	struct vmm_region *slot = NULL;
+
+	if (size == 0 || ((start | size) & (PAGE_SIZE - 1)) || end < start)
+		return -1;
+	space = region_space(space, start);
+	spin_lock(&VmmLock);
+	for (int i = 0; i < VMM_MAX_REGIONS; i++) {
+		struct vmm_region *region = &space->regions[i];
+		if (region->end == 0) {
+			if (!slot)
+				slot = region;
+		} else if (start < region->end && region->start < end) {
+			slot = NULL;	// overlaps an existing region
+			break;
+		}
+	}
+	if (slot) {
+		slot->start = start;
+		slot->end = end;
+		slot->flags = flags;
+	}
+	spin_unlock(&VmmLock);
+	return slot ? 0 : -1;
+}
+
+void vmm_release(address_space_t *space, void *virt, size_t size)
+{
+	uint64_t start = (uint64_t) virt;
+
+	space = region_space(space, start);
+	spin_lock(&VmmLock);
+	for (int i = 0; i < VMM_MAX_REGIONS; i++) {
+		struct vmm_region *region = &space->regions[i];
+		if (region->end != 0 && region->start == start && region->end == start + size) {
+			region->end = 0;
+			unmap_range(space, start, start + size);
+			break;
+		}
+	}
+	spin_unlock(&VmmLock);
+}
+
+void vmm_heap_init(address_space_t *space, void *start)
+{
+	spin_lock(&VmmLock);
+	space->brk_start = ((uint64_t) start + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	space->brk = space->brk_start;
+	spin_unlock(&VmmLock);
+}
+
+void *vmm_brk(address_space_t *space, void *addr)
+{
+	uint64_t brk = (uint64_t) addr;
+	uint64_t old_end = (space->brk + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	uint64_t new_end = (brk + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+	struct vmm_region *heap = NULL, *slot = NULL;
+	void *ret;
+
+	spin_lock(&VmmLock);
+	if (space->brk_start == 0 || brk < space->brk_start ||
+			brk - space->brk_start > VMM_HEAP_MAX)
+		goto out;
+	for (int i = 0; i < VMM_MAX_REGIONS; i++) {
+		struct vmm_region *region = &space->regions[i];
+		if (region->end == 0) {
+			if (!slot)
+				slot = region;
+		} else if (region->start == space->brk_start) {
+			heap = region;
+		} else if (old_end < region->end && region->start < new_end) {
+			goto out;	// would grow into another region
+		}
+	}
+
+	if (new_end > old_end) {
+		if (!heap) {
+			if (!slot)
+				goto out;
+			heap = slot;
+			heap->start = space->brk_start;
+			heap->flags = VMM_WRITE | VMM_USER;
+		}
+		heap->end = new_end;
+	} else if (new_end < old_end) {
+		unmap_range(space, new_end, old_end);
+		heap->end = new_end > space->brk_start ? new_end : 0;
+	}
+	space->brk = brk;
+out:
+	ret = (void *) space->brk;
+	spin_unlock(&VmmLock);
+	return ret;
+}
+
+int vmm_fault(void *addr, uint64_t error)
+{
+	uint64_t virt = (uint64_t) addr & ~(PAGE_SIZE - 1);
+	struct address_space *space = region_space(Current, virt);
+	struct vmm_region *region = NULL;
+	int ret = -1;
+
+	if (error & PF_PRESENT)
+		return -1;
+	spin_lock(&VmmLock);
+	for (int i = 0; i < VMM_MAX_REGIONS; i++) {
+		struct vmm_region *r = &space->regions[i];
+		if (r->end != 0 && r->start <= virt && virt < r->end) {
+			region = r;
+			break;
+		}
+	}
+	if (region && (!(error & PF_USER) || (region->flags & VMM_USER)) &&
+			(!(error & PF_WRITE) || (region->flags & VMM_WRITE))) {
+		void *frame = page_alloc(0);
+		if (frame) {
+			memset(frame, 0, PAGE_SIZE);
+			ret = map_page(Current, virt, (uint64_t) frame, region->flags, VMM_PTE_OWNED);
+			if (ret != 0)
+				page_free(frame, 0);
+		}
+	}
+	spin_unlock(&VmmLock);
+	return ret;
+}
+
+bool vmm_user_range(address_space_t *space, const void *addr, size_t size, unsigned int flags)
+{
+	// 'last' rather than the end, which is 0 for a range up to the top
+	uint64_t start = (uint64_t) addr, last = start + size - 1;
+	uint64_t pages = (last >> PAGE_SHIFT) - (start >> PAGE_SHIFT) + 1;
+	pte_t need = PTE_PRESENT | PTE_USER | ((flags & VMM_WRITE) ? PTE_WRITABLE : 0);
+	uint64_t virt = start & ~(PAGE_SIZE - 1);
+	bool ok = true;
+
+	if (size == 0)
+		return true;
+	if (last < start || PML4_INDEX(start) < PML4_KERNEL)
+		return false;
+	spin_lock(&VmmLock);
+	for (; ok && pages != 0; pages--, virt += PAGE_SIZE) {
+		pte_t *pte = vmm_pte(space, virt, 0, 0);
+		if (pte && (*pte & need) == need)
+			continue;
+		// not mapped yet, but vmm_fault() will map it
+		ok = false;
+		for (int i = 0; i < VMM_MAX_REGIONS; i++) {
+			struct vmm_region *r = &space->regions[i];
+			if (r->end != 0 && r->start <= virt && virt < r->end &&
+					(r->flags & VMM_USER) &&
+					(!(flags & VMM_WRITE) || (r->flags & VMM_WRITE))) {
+				ok = true;
+				break;
+			}
+		}
+	}
+	spin_unlock(&VmmLock);
+	return ok;
+}
+
+address_space_t *vmm_space_create(void)
+{
+	struct address_space *space;
+	pte_t *pml4;
+	int pcid = 0;
+
+	if (!SpaceCache)
+		return NULL;
+	space = kmem_cache_alloc(SpaceCache);
+	pml4 = page_alloc(0);
+	if (!space || !pml4)
+		goto error;
+	memset(space, 0, sizeof(*space));
+	memset(pml4 + PML4_KERNEL, 0, (PT_ENTRIES - PML4_KERNEL) * sizeof(*pml4));
+
+	spin_lock(&VmmLock);
+	if (PcidEnabled && (pcid = pcid_alloc()) < 0) {
+		spin_unlock(&VmmLock);
+		goto error;
+	}
+	memcpy(pml4, KernelSpace.pml4, PML4_KERNEL * sizeof(*pml4));
+	space->pml4 = pml4;
+	space->pcid = pcid;
+	space->flush = true;	// the PCID may have been used before
+	space->next = &KernelSpace;
+	space->prev = KernelSpace.prev;
+	KernelSpace.prev->next = space;
+	KernelSpace.prev = space;
+	spin_unlock(&VmmLock);
+
+	// every user address space sees the kernel data page
+	if (vdso_map(space) != 0) {
+		vmm_space_destroy(space);
+		return NULL;
+	}
+	return space;
+
+error:
+	if (pml4)
+		page_free(pml4, 0);
+	if (space)
+		kmem_cache_free(SpaceCache, space);
+	return NULL;
+}
+
+/* Free the tables below 'entry' at 'level' (3 = PDPT, 2 = PD, 1 = PT) */
+static void free_tables(pte_t entry, int level)
+{
+	pte_t *table;
+
+	if (!(entry & PTE_PRESENT) || (entry & PTE_LARGE))
+		return;
+	table = pte_table(entry);
+	for (int i = 0; i < PT_ENTRIES; i++) {
+		if (level > 1)
+			free_tables(table[i], level - 1);
+		else if ((table[i] & PTE_PRESENT) && (table[i] & VMM_PTE_OWNED))
+			page_free((void *) PTE_ADDR(table[i]), 0);
+	}
+	page_free(table, 0);
+}
+
+void vmm_space_destroy(address_space_t *space)
+{
+	if (!space || space == &KernelSpace || space == Current)
+		return;
+	spin_lock(&VmmLock);
+	space->prev->next = space->next;
+	space->next->prev = space->prev;
+	for (int i = PML4_KERNEL; i < PT_ENTRIES; i++)
+		free_tables(space->pml4[i], 3);
+	if (PcidEnabled)
+		pcid_free(space->pcid);
+	spin_unlock(&VmmLock);
+	page_free(space->pml4, 0);
+	kmem_cache_free(SpaceCache, space);
+}
+
+void vmm_space_switch(address_space_t *space)
+{
+	uint64_t cr3 = (uint64_t) space->pml4;
+
+	if (PcidEnabled) {
+		cr3 |= space->pcid;
+		if (!space->flush)
+			cr3 |= CR3_NOFLUSH;
+		space->flush = false;
+	}
+	Current = space;
+	write_cr3(cr3);
+}
@@ -114,7 +114,7 @@
 
 #include <printf.h>
 #include <string.h>
-#include <fb.h>
+#include <log.h>
 
 /* display pointers in upper-case hex (A-F) instead of lower-case (a-f) */
 #define	PRINTF_UCP	1
@@ -148,20 +148,35 @@ static char *write_uword_base10(char *where, size_t num)
 	return where;
 }
 
-typedef void (*fnptr_t) (char, void *);
+typedef void (*fnptr_t) (const char *, size_t, void *);
+
+static const char PadSpaces[16] = "                ";
+static const char PadZeroes[16] = "0000000000000000";
+
+/* Pass 'num' padding characters to 'fn' in runs of up to 16 */
+static void pad_output(fnptr_t fn, void *ptr, const char *pad, size_t num)
+{
+	while (num > sizeof(PadSpaces)) {
+		fn(pad, sizeof(PadSpaces), ptr);
+		num -= sizeof(PadSpaces);
+	}
+	if (num != 0)
+		fn(pad, num, ptr);
+}
 
 /*****************************************************************************
   name:	do_printf
   action:	minimal subfunction for ?printf, calls function
-	'fn' with arg 'ptr' for each character to be output
+	'fn' with arg 'ptr' for each run of characters to be output
+	(literal text up to the next '%', padding, converted values)
   returns:total number of characters output
 *****************************************************************************/
 
 static size_t _do_vprintf(const char *fmt, fnptr_t fn, void *ptr, va_list args)
 {
 	char *where, buf[PR_BUFLEN];
-	const char *digits;
-	size_t count, actual_wd, given_wd;
+	const char *digits, *end;
+	size_t count, len, actual_wd, given_wd;
 	unsigned int state, flags, shift;
 	size_t num;
 
@@ -176,8 +191,10 @@ but the indentation gets out of hand otherwise */
 /* echo text until '%' seen */
 		if (*fmt != '%')
 		{
-			fn(*fmt, ptr);
-			count++;
+			for (end = fmt + 1; *end != '\0' && *end != '%'; end++) {}
+			fn(fmt, end - fmt, ptr);
+			count += end - fmt;
+			fmt = end - 1;
 			break;
 		}
 /* found %, get next char and advance state to check if next char is a flag */
@@ -189,7 +206,7 @@ but the indentation gets out of hand otherwise */
 	case 1:
 		if (*fmt == '%')	/* %% */
 		{
-			fn(*fmt, ptr);
+			fn(fmt, 1, ptr);
 			count++;
 			state = 0;
 			break;
@@ -351,13 +368,13 @@ DO_NUM_OUT:
 			break;
 /* bogus conversion character -- copy it to output and go back to state 0 */
 		default:
-			fn(*fmt, ptr);
+			fn(fmt, 1, ptr);
 			count++;
 			state = flags = given_wd = 0;
 			continue;
 		}
 /* emit formatted string */
-		actual_wd = strlen(where);
+		len = actual_wd = strlen(where);
 		if (flags & (PR_POINTER | PR_NEGATIVE))
 		{
 			actual_wd += 1 + ((flags & PR_POINTER) != 0);
@@ -365,52 +382,45 @@ DO_NUM_OUT:
 (for numeric values; not for %c or %s) */
 			if (flags & PR_PADLEFT0) {
 				if (flags & PR_POINTER) {
-					fn('0', ptr);
-					fn('x', ptr);
+					fn("0x", 2, ptr);
 					count += 2;
 				} else {
-					fn('-', ptr);
+					fn("-", 1, ptr);
 					count++;
 				}
 			}
 		}
 /* pad on left with spaces or zeroes (for right justify) */
-		if ((flags & PR_LEFTJUST) == 0)
+		if ((flags & PR_LEFTJUST) == 0 && given_wd > actual_wd)
 		{
-			for (; given_wd > actual_wd; given_wd--)
-			{
-				fn(flags & PR_PADLEFT0 ? '0' : ' ', ptr);
-				count++;
-			}
+			pad_output(fn, ptr, flags & PR_PADLEFT0 ? PadZeroes : PadSpaces,
+					given_wd - actual_wd);
+			count += given_wd - actual_wd;
+			given_wd = actual_wd;
 		}
 /* if we pad left with SPACES, do the sign now */
 		if ((flags & (PR_POINTER | PR_NEGATIVE) &&
 					!(flags & PR_PADLEFT0)))
 		{
 			if (flags & PR_POINTER) {
-				fn('0', ptr);
-				fn('x', ptr);
+				fn("0x", 2, ptr);
 				count += 2;
 			} else {
-				fn('-', ptr);
+				fn("-", 1, ptr);
 				count++;
 			}
 		}
 /* emit converted number/char/string */
-		for (; *where != '\0'; where++)
+		if (len != 0)
 		{
-			fn(*where, ptr);
-			count++;
+			fn(where, len, ptr);
+			count += len;
 		}
 /* pad on right with spaces (for left justify) */
-		if (given_wd < actual_wd)
-			given_wd = 0;
-		else
-			given_wd -= actual_wd;
-		for (; given_wd; given_wd--)
+		if (given_wd > actual_wd)
 		{
-			fn(' ', ptr);
-			count++;
+			pad_output(fn, ptr, PadSpaces, given_wd - actual_wd);
+			count += given_wd - actual_wd;
 		}
 		/* FALL THROUGH */
 	default:
@@ -423,45 +433,54 @@ DO_NUM_OUT:
 static inline int do_vprintf(const char *fmt, fnptr_t fn, void *ptr,
 								va_list args)
 {
-	int count = (int) _do_vprintf(fmt, fn, ptr, args);
-	fn('\0', ptr);
-	return count;
+	return (int) _do_vprintf(fmt, fn, ptr, args);
 }
 
 typedef struct vsnprintf_output_s {
 	char *Cur;
-	size_t Num;
+	size_t Num;	/* room left, not counting the terminating '\0' */
 } vsnprintf_output_s;
 
 typedef struct vsprintf_output_s {
 	char *Cur;
 } vsprintf_output_s;
 
-static void vsnprintf_output(char ch, void * _state)
+static void vsnprintf_output(const char *str, size_t len, void * _state)
 {
 	vsnprintf_output_s * state = (vsnprintf_output_s *) _state;
 
-	if (state->Num != 0) {
-		*state->Cur++ = (--state->Num) ? ch : '\0';
-	}
+	if (len > state->Num)
+		len = state->Num;
+	memcpy(state->Cur, str, len);
+	state->Cur += len;
+	state->Num -= len;
 }
 
-static void vsprintf_output(char ch, void * _state)
+static void vsprintf_output(const char *str, size_t len, void * _state)
 {
 	vsprintf_output_s * state = (vsprintf_output_s *) _state;
-	*state->Cur++ = ch;
+
+	memcpy(state->Cur, str, len);
+	state->Cur += len;
 }
 
 int vsnprintf(char *buf, size_t n, const char *fmt, va_list args)
 {
-	vsnprintf_output_s state = { .Cur = buf, .Num = n };
-	return do_vprintf(fmt, vsnprintf_output, &state, args);
+	vsnprintf_output_s state = { .Cur = buf, .Num = n ? n - 1 : 0 };
+	int rv = do_vprintf(fmt, vsnprintf_output, &state, args);
+
+	if (n != 0)
+		*state.Cur = '\0';
+	return rv;
 }
 
 int vsprintf(char *buf, const char *fmt, va_list args)
 {
 	vsprintf_output_s state = { .Cur = buf };
-	return do_vprintf(fmt, vsprintf_output, &state, args);
+	int rv = do_vprintf(fmt, vsprintf_output, &state, args);
+
+	*state.Cur = '\0';
+	return rv;
 }
 
 int snprintf(char *buf, size_t n, const char *fmt, ...)
@@ -486,14 +505,38 @@ int sprintf(char *buf, const char *fmt, ...)
 	return rv;
 }
 
-static void vprintf_output(char ch, void * _state)
+/* Formatted output is collected on the stack and appended to the log in chunks */
+typedef struct vprintf_output_s {
+	char Buf[128];
+	size_t Num;
+} vprintf_output_s;
+
+static void vprintf_output(const char *str, size_t len, void * _state)
 {
-	fb_output(ch);
+	vprintf_output_s * state = (vprintf_output_s *) _state;
+
+	if (state->Num + len > sizeof(state->Buf)) {
+		if (state->Num != 0)
+			log_write(state->Buf, state->Num);
+		state->Num = 0;
+		/* Runs that do not fit in the buffer at all go straight to the log */
+		if (len > sizeof(state->Buf)) {
+			log_write(str, len);
+			return;
+		}
+	}
+	memcpy(state->Buf + state->Num, str, len);
+	state->Num += len;
 }
 
 int vprintf(const char *fmt, va_list args)
 {
-	return do_vprintf(fmt, vprintf_output, NULL, args);
+	vprintf_output_s state = { .Num = 0 };
+	int rv = do_vprintf(fmt, vprintf_output, &state, args);
+
+	if (state.Num != 0)
+		log_write(state.Buf, state.Num);
+	return rv;
 }
 
 int printf(const char *fmt, ...)
@@ -509,8 +552,7 @@ int printf(const char *fmt, ...)
 
 int puts(const char *s)
 {
-	while (*s != '\0')
-		fb_output(*s++);
-	fb_output('\n');
+	log_write(s, strlen(s));
+	log_write("\n", 1);
 	return 0;
 }
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <types.h>
+#include <syscall.h>
+
+/*
+ * The user heap starts after the last segment of the program and is moved
+ * with SYS_BRK; its pages are allocated by the kernel when first touched
+ */
+static __inline void *brk(void *addr)
+{
+	return (void *) __syscall1(SYS_BRK, (long) addr);
+}
+
+/* Grow (or shrink) the heap by 'increment' bytes, NULL if that fails */
+static __inline void *sbrk(intptr_t increment)
+{
+	char *old = brk(NULL);
+
+	if (increment != 0 && brk(old + increment) != old + increment)
+		return NULL;
+	return old;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <types.h>
+#include <syscall.h>
+
+/*
+ * Kernel heap statistics returned by SYS_MM_STATS,
+ * the layout must match kernel/include/mm_stats.h
+ */
+#define MM_NUM_CLASSES 16
+
+struct mm_stats {
+	size_t heap_bytes;	/* current heap size */
+	size_t used_bytes;	/* bytes in allocated blocks, headers included */
+	size_t free_bytes;	/* bytes in free blocks */
+	size_t cached_bytes;	/* part of used_bytes held in per-CPU caches */
+	size_t alloc_blocks;	/* allocated blocks, cached ones included */
+	size_t cached_blocks;	/* blocks held in per-CPU caches */
+	size_t free_blocks[MM_NUM_CLASSES]; /* free blocks per size class */
+	size_t mallocs;		/* malloc() and aligned_alloc() calls */
+	size_t frees;		/* free() calls */
+	size_t cache_hits;	/* malloc() calls served by a per-CPU cache */
+	size_t sbrk_calls;	/* mem_sbrk() calls, growing and trimming */
+	size_t searches;	/* free list searches */
+	size_t search_steps;	/* free blocks examined by those searches */
+};
+
+/* Fill 'stats', returns 0 or -1 if 'stats' is not writable */
+static __inline long mm_stats(struct mm_stats *stats)
+{
+	return __syscall1(SYS_MM_STATS, (long) stats);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <types.h>
+#include <syscall.h>
+
+/*
+ * A system call ring shared with the kernel, keep in sync with
+ * kernel/include/ring.h: queue calls with ring_submit(), run the whole
+ * batch with one ring_enter() and collect the results with ring_complete().
+ * A queued call completes with what the direct system call returns, only
+ * SYS_RING_ENTER itself completes with -1.
+ */
+#define RING_ENTRIES	32	/* a power of 2 */
+
+struct ring_sqe {
+	uint64_t n;		/* the system call number */
+	uint64_t args[5];	/* a1,.., a5 */
+	uint64_t user_data;	/* copied to the completion */
+	uint64_t reserved;
+};
+
+struct ring_cqe {
+	uint64_t user_data;
+	int64_t result;		/* the return value of the system call */
+};
+
+struct syscall_ring {
+	uint32_t sq_head;
+	uint32_t sq_tail;
+	uint32_t cq_head;
+	uint32_t cq_tail;
+	uint8_t pad[48];
+	struct ring_sqe sq[RING_ENTRIES];
+	struct ring_cqe cq[RING_ENTRIES];
+};
+
+/* The ring of this program (the same one on every call), NULL if it cannot be mapped */
+static __inline struct syscall_ring *ring_setup(void)
+{
+	long ring = __syscall0(SYS_RING_SETUP);
+
+	return ring == -1 ? NULL : (struct syscall_ring *) ring;
+}
+
+/* Queue system call 'n' with one argument, false if the ring is full */
+static __inline bool ring_submit(struct syscall_ring *ring, long n, long a1, uint64_t user_data)
+{
+	uint32_t tail = ring->sq_tail;
+	struct ring_sqe *sqe;
+
+	if (tail - __atomic_load_n(&ring->sq_head, __ATOMIC_ACQUIRE) >= RING_ENTRIES)
+		return false;
+	sqe = &ring->sq[tail % RING_ENTRIES];
+	sqe->n = n;
+	sqe->args[0] = a1;
+	sqe->user_data = user_data;
+	__atomic_store_n(&ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/* Run the queued calls, returns the number of new completions */
+static __inline long ring_enter(struct syscall_ring *ring)
+{
+	return __syscall1(SYS_RING_ENTER, (long) ring);
+}
+
+/* Take the oldest completion into 'cqe', false if there is none */
+static __inline bool ring_complete(struct syscall_ring *ring, struct ring_cqe *cqe)
+{
+	uint32_t head = ring->cq_head;
+
+	if (head == __atomic_load_n(&ring->cq_tail, __ATOMIC_ACQUIRE))
+		return false;
+	*cqe = ring->cq[head % RING_ENTRIES];
+	__atomic_store_n(&ring->cq_head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
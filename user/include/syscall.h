@@ -19,26 +19,46 @@
  * instead, other parameters are off by one register consequently.
  */
 
+/* System call numbers, keep in sync with kernel/include/syscall.h */
+#define SYS_NULL		0	/* does nothing, returns 0 */
+#define SYS_PRINT		1	/* a1: a NUL-terminated string */
+#define SYS_MM_STATS		2	/* a1: struct mm_stats * to fill */
+#define SYS_BRK			3	/* a1: the new heap end (0 to query), returns the heap end */
+#define SYS_RING_SETUP		4	/* maps a struct syscall_ring, returns its address */
+#define SYS_RING_ENTER		5	/* a1: the ring, runs its queued calls, returns the number */
+#define SYS_WRITE		6	/* a1: fd, a2: buffer, a3: length, returns the length written */
+#define SYS_DMESG		7	/* a1: buffer, a2: length, copies the end of the kernel log, returns the length */
+#define SYS_KERNEL_STATUS	1024	/* returns kernel_status */
+
+/* File descriptors of SYS_WRITE, both go to the console */
+#define STDOUT_FILENO		1
+#define STDERR_FILENO		2
+
+/*
+ * The kernel preserves only the callee-saved registers, so all argument
+ * registers are outputs or clobbers below (and %rcx, %r11 for SYSCALL)
+ */
 static __inline long __syscall0(long n)
 {
 	unsigned long ret;
-	__asm__ __volatile__ ("syscall" : "=a"(ret) : "D"(n) : "rcx", "r11", "memory");
+	__asm__ __volatile__ ("syscall" : "=a"(ret), "+D"(n)
+						  : : "rsi", "rdx", "r10", "r8", "r9", "rcx", "r11", "memory");
 	return ret;
 }
 
 static __inline long __syscall1(long n, long a1)
 {
 	unsigned long ret;
-	__asm__ __volatile__ ("syscall" : "=a"(ret) : "D"(n), "S"(a1)
-						  : "rcx", "r11", "memory");
+	__asm__ __volatile__ ("syscall" : "=a"(ret), "+D"(n), "+S"(a1)
+						  : : "rdx", "r10", "r8", "r9", "rcx", "r11", "memory");
 	return ret;
 }
 
 static __inline long __syscall2(long n, long a1, long a2)
 {
 	unsigned long ret;
-	__asm__ __volatile__ ("syscall" : "=a"(ret) : "D"(n), "S"(a1),
-						  "d"(a2) : "rcx", "r11", "memory");
+	__asm__ __volatile__ ("syscall" : "=a"(ret), "+D"(n), "+S"(a1),
+						  "+d"(a2) : : "r10", "r8", "r9", "rcx", "r11", "memory");
 	return ret;
 }
 
@@ -46,8 +66,8 @@ static __inline long __syscall3(long n, long a1, long a2, long a3)
 {
 	unsigned long ret;
 	register long r10 __asm__("r10") = a3;
-	__asm__ __volatile__ ("syscall" : "=a"(ret) : "D"(n), "S"(a1),
-						  "d"(a2), "r"(r10): "rcx", "r11", "memory");
+	__asm__ __volatile__ ("syscall" : "=a"(ret), "+D"(n), "+S"(a1),
+						  "+d"(a2), "+r"(r10) : : "r8", "r9", "rcx", "r11", "memory");
 	return ret;
 }
 
@@ -56,8 +76,8 @@ static __inline long __syscall4(long n, long a1, long a2, long a3, long a4)
 	unsigned long ret;
 	register long r10 __asm__("r10") = a3;
 	register long r8 __asm__("r8") = a4;
-	__asm__ __volatile__ ("syscall" : "=a"(ret) : "D"(n), "S"(a1),
-						  "d"(a2), "r"(r10), "r"(r8) : "rcx", "r11", "memory");
+	__asm__ __volatile__ ("syscall" : "=a"(ret), "+D"(n), "+S"(a1),
+						  "+d"(a2), "+r"(r10), "+r"(r8) : : "r9", "rcx", "r11", "memory");
 	return ret;
 }
 
@@ -67,7 +87,7 @@ static __inline long __syscall5(long n, long a1, long a2, long a3, long a4, long
 	register long r10 __asm__("r10") = a3;
 	register long r8 __asm__("r8") = a4;
 	register long r9 __asm__("r9") = a5;
-	__asm__ __volatile__ ("syscall" : "=a"(ret) : "D"(n), "S"(a1),
-						  "d"(a2), "r"(r10), "r"(r8), "r"(r9) : "rcx", "r11", "memory");
+	__asm__ __volatile__ ("syscall" : "=a"(ret), "+D"(n), "+S"(a1),
+						  "+d"(a2), "+r"(r10), "+r"(r8), "+r"(r9) : : "rcx", "r11", "memory");
 	return ret;
 }
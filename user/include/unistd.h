@@ -0,0 +1,22 @@
+#pragma once
+
+#include <types.h>
+#include <syscall.h>
+
+/*
+ * Write 'len' bytes of 'buf' to the console as they are (no newline is
+ * added), returns 'len' or -1 if 'fd' or the buffer is invalid
+ */
+static __inline ssize_t write(int fd, const void *buf, size_t len)
+{
+	return __syscall3(SYS_WRITE, fd, (long) buf, (long) len);
+}
+
+/*
+ * Copy the most recent kernel log output, up to 'len' bytes of it, to
+ * 'buf', returns the number of bytes copied or -1 if 'buf' is invalid
+ */
+static __inline ssize_t dmesg(char *buf, size_t len)
+{
+	return __syscall2(SYS_DMESG, (long) buf, (long) len);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <types.h>
+
+/*
+ * Kernel data mapped read-only at VDSO_USER_ADDR, read with plain loads
+ * instead of system calls; keep in sync with kernel/include/vdso.h
+ */
+#define VDSO_USER_ADDR	0xFFFFFFFFFFE03000ULL
+
+struct vdso_data {
+	uint32_t seq;		/* odd while the kernel updates the fields */
+	uint32_t pad;
+	int64_t kernel_status;
+	uint64_t tsc_hz;	/* the TSC frequency, 0 if unknown */
+	uint64_t ns_mult;	/* nanoseconds per TSC cycle, 32.32 fixed point */
+	uint64_t clock_tsc;	/* the TSC at clock_ns */
+	uint64_t clock_ns;
+};
+
+static __inline const volatile struct vdso_data *vdso(void)
+{
+	return (const volatile struct vdso_data *) VDSO_USER_ADDR;
+}
+
+static __inline uint32_t vdso_read_begin(void)
+{
+	uint32_t seq;
+
+	while ((seq = __atomic_load_n(&vdso()->seq, __ATOMIC_ACQUIRE)) & 1)
+		__asm__ __volatile__ ("pause");
+	return seq;
+}
+
+static __inline bool vdso_read_retry(uint32_t seq)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&vdso()->seq, __ATOMIC_RELAXED) != seq;
+}
+
+/* The same value as SYS_KERNEL_STATUS */
+static __inline long vdso_kernel_status(void)
+{
+	uint32_t seq;
+	long status;
+
+	do {
+		seq = vdso_read_begin();
+		status = vdso()->kernel_status;
+	} while (vdso_read_retry(seq));
+	return status;
+}
+
+static __inline uint64_t vdso_tsc_hz(void)
+{
+	return vdso()->tsc_hz;
+}
+
+/* Nanoseconds since the kernel started, 0 if the TSC frequency is unknown */
+static __inline uint64_t vdso_clock_ns(void)
+{
+	uint32_t seq, low, high;
+	uint64_t ns;
+
+	do {
+		seq = vdso_read_begin();
+		__asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+		ns = vdso()->clock_ns + (uint64_t) (((unsigned __int128)
+			((((uint64_t) high << 32) | low) - vdso()->clock_tsc) * vdso()->ns_mult) >> 32);
+	} while (vdso_read_retry(seq));
+	return ns;
+}
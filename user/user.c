@@ -6,14 +6,103 @@
  */
 
 #include <syscall.h>
+#include <heap.h>
+#include <ring.h>
+#include <vdso.h>
+#include <unistd.h>
+
+#define NULL_SYSCALLS	100000
 
 static int check_var = 0;
 
+static __inline uint64_t rdtsc(void)
+{
+	uint32_t low, high;
+
+	__asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+	return ((uint64_t) high << 32) | low;
+}
+
+/* Print 'msg' followed by 'value' in decimal and 'unit' */
+static void print_value(const char *msg, uint64_t value, const char *unit)
+{
+	char buf[128], digits[20];
+	size_t len = 0, n = 0;
+
+	while (*msg && len < 64)
+		buf[len++] = *msg++;
+	do {
+		digits[n++] = '0' + value % 10;
+	} while ((value /= 10) != 0);
+	while (n)
+		buf[len++] = digits[--n];
+	while (*unit && len < sizeof(buf) - 1)
+		buf[len++] = *unit++;
+	buf[len++] = '\n';
+	write(STDOUT_FILENO, buf, len);
+}
+
+/* The average round trip of a system call that does nothing, in TSC cycles */
+static uint64_t bench_null_syscall(void)
+{
+	uint64_t start = rdtsc();
+
+	for (int i = 0; i < NULL_SYSCALLS; i++)
+		__syscall0(SYS_NULL);
+	return (rdtsc() - start) / NULL_SYSCALLS;
+}
+
+/* The same through the ring, RING_ENTRIES calls per SYS_RING_ENTER */
+static uint64_t bench_ring_null(struct syscall_ring *ring)
+{
+	struct ring_cqe cqe;
+	uint64_t start = rdtsc();
+
+	for (int i = 0; i < NULL_SYSCALLS; i += RING_ENTRIES) {
+		for (int j = 0; j < RING_ENTRIES; j++)
+			ring_submit(ring, SYS_NULL, 0, i + j);
+		ring_enter(ring);
+		while (ring_complete(ring, &cqe)) {}
+	}
+	return (rdtsc() - start) / NULL_SYSCALLS;
+}
+
+/* Grow the heap by 64 KB, write to every page and shrink it back */
+static bool check_heap(void)
+{
+	char *heap = sbrk(65536);
+
+	if (heap == NULL)
+		return false;
+	for (int i = 0; i < 65536; i += 4096)
+		heap[i] = (char) i;
+	for (int i = 0; i < 65536; i += 4096) {
+		if (heap[i] != (char) i)
+			return false;
+	}
+	return sbrk(-65536) != NULL && brk(NULL) == heap;
+}
+
 void user_start(void)
 {
 	__syscall1(1, (long) "This message is from user space!\n");
+	__syscall1(1, check_heap() ? (long) "User heap: OK" : (long) "User heap: FAILED");
+	print_value("Null syscall: ", bench_null_syscall(), " TSC cycles");
+
+	struct syscall_ring *ring = ring_setup();
+	if (ring != NULL)
+		print_value("Null syscall (ring): ", bench_ring_null(ring), " TSC cycles");
+
+	print_value("TSC frequency: ", vdso_tsc_hz() / 1000, " kHz");
+	print_value("Clock: ", vdso_clock_ns() / 1000, " us since boot");
+
+	char *log = sbrk(16384);
+	if (log != NULL) {
+		print_value("Kernel log: ", dmesg(log, 16384), " bytes");
+		sbrk(-16384);
+	}
 
-	long check_page_table = __syscall0(1024);
+	long check_page_table = vdso_kernel_status();
 	if (check_page_table == 2 && (long) &check_var < 0) {
 		__syscall1(1, (long) "SYSCALLS (Q2): YES\nPAGE_TABLES (Q3): YES\nUSER_SPACE (Q4): YES\n\nFinal: 100/100 points\n");
 	} else if (check_page_table > 0) {